@@ -8,13 +8,16 @@
 #include "../surfaces/Rectangle_XZ.h"
 #include "../surfaces/Rectangle_YZ.h"
 #include "../surfaces/Triangle.h"
+#include "../surfaces/TriangleMesh.h"
 #include "../surfaces/SquarePyramid_XZ.h"
 #include "../surfaces/transformations/RotateY.h"
 #include "../surfaces/transformations/RotateX.h"
 #include "../surfaces/transformations/RotateZ.h"
 #include "../surfaces/transformations/Translate.h"
+#include "../surfaces/transformations/Instance.h"
 #include "../surfaces/Block.h"
 #include "../surfaces/FlipNormals.h"
+#include "../surfaces/acceleration/LinearBoundingVolumeHierarchy.h"
 #include "../utility/Camera.h"
 #include "../material/Lambertian.h"
 #include "../material/Metal.h"
@@ -25,12 +28,37 @@
 #include "../material/DiffuseLight.h"
 #include "../material/texture/Perlin.h"
 
+// The placement and lens of a camera, from which cameras of any resolution can be created.
+struct CameraSettings {
+    BoundVec3 look_from;
+    FreeVec3 look_at;
+    FreeVec3 view_up;
+    // The field of view from top to bottom, in degrees.
+    value_type field_of_view;
+    value_type aperture;
+    value_type focus_distance;
+    // The shutter time of the camera.
+    value_type time0, time1;
+
+    // Creates the camera, with an aspect determined by ('x_pixels' / 'y_pixels').
+    std::unique_ptr<const Camera> create(int x_pixels, int y_pixels) const {
+        const value_type aspect = value_type(x_pixels) / value_type(y_pixels);
+        return std::make_unique<Camera>(Camera(look_from, look_at, view_up, field_of_view, aspect,
+                                               aperture, focus_distance, time0, time1));
+    }
+};
+
 // Represents a scene. The world contains the hittables, and the camera contains the necessary angles and times.
 struct Scene {
     // The camera used for the current scene.
     std::unique_ptr<const Camera> camera;
+    // The settings 'camera' was created from, e.g. to create it again at another resolution.
+    CameraSettings camera_settings;
     // The necessary surfaces for the current scene that produces the "world".
-    std::unique_ptr<const HittableWorld> world;
+    // This is either 'hittables' itself, or an acceleration structure built over it.
+    std::shared_ptr<const Hittable> world;
+    // The surfaces of the scene, before any acceleration structure is built over them.
+    std::shared_ptr<const HittableWorld> hittables;
     // The maximum allowable recursion depth for coloring.
     int maximum_recursion_depth;
     // TODO: If no light is provided, add background
@@ -47,13 +75,13 @@ Scene cornell_box(int x_pixels, int y_pixels, int maximum_recursion_depth) {
     const value_type field_of_view = 40.0;
     const value_type time0 = 0.0;
     const value_type time1 = 1.0;
-    const value_type aspect = value_type(x_pixels)/value_type(y_pixels);
-    auto current_camera = std::make_unique<Camera>(Camera(look_from, look_at, view_up, field_of_view, aspect,
-                        aperture, distance_to_focus, time0, time1));
+    const CameraSettings camera_settings{look_from, look_at, view_up, field_of_view, aperture, distance_to_focus,
+                                         time0, time1};
+    auto current_camera = camera_settings.create(x_pixels, y_pixels);
 
     // World.
     const int num_hittables = 8;
-    auto hittable_list = std::make_unique<HittableWorld>(HittableWorld(num_hittables));
+    auto hittable_list = std::make_shared<HittableWorld>(HittableWorld(num_hittables));
 
     const auto red_texture = std::make_shared<ConstantTexture>(ConstantTexture(Color3(0.65, 0.05, 0.05)));
     const auto white_texture = std::make_shared<ConstantTexture>(ConstantTexture(Color3(0.73, 0.73, 0.73)));
@@ -93,18 +121,20 @@ Scene cornell_box(int x_pixels, int y_pixels, int maximum_recursion_depth) {
     const auto right_block = std::make_shared<Block>(Block(BoundVec3(0.0, 0.0, 0.0), BoundVec3(165.0, 165.0, 165.0),
                                                     white_material));
     const auto right_block_offset = FreeVec3(130.0, 0.0, 65.0);
-    const auto right_block_rotation = std::make_shared<RotateY>(RotateY(right_block, /*angle_in_degrees=*/-18.0));
-    hittable_list->add(std::make_shared<Translate>(Translate(right_block_rotation, right_block_offset)));
+    hittable_list->add(std::make_shared<Instance>(Instance(right_block,
+            AffineTransform::translation(right_block_offset) * AffineTransform::rotation_y(-18.0))));
 
     // Left block.
     const auto left_block = std::make_shared<Block>(Block(BoundVec3(0.0, 0.0, 0.0), BoundVec3(165.0, 330.0, 165.0),
                                                      white_material));
     const auto left_block_offset = FreeVec3(265.0, 0.0, 295.0);
-    const auto left_block_rotation = std::make_shared<RotateY>(RotateY(right_block, /*angle_in_degrees=*/15.0));
-    hittable_list->add(std::make_shared<Translate>(Translate(left_block_rotation, left_block_offset)));
+    hittable_list->add(std::make_shared<Instance>(Instance(right_block,
+            AffineTransform::translation(left_block_offset) * AffineTransform::rotation_y(15.0))));
 
     return Scene{.camera=std::move(current_camera),
-                 .world=std::move(hittable_list),
+                 .camera_settings=camera_settings,
+                 .world=hittable_list,
+                 .hittables=hittable_list,
                  .maximum_recursion_depth=maximum_recursion_depth};
 }
 
@@ -119,9 +149,9 @@ Scene perlin_noise_demonstration(int x_pixels, int y_pixels, int maximum_recursi
     const value_type field_of_view = 20.0;
     const value_type time0 = 0.0;
     const value_type time1 = 1.0;
-    const value_type aspect = value_type(x_pixels)/value_type(y_pixels);
-    auto current_camera = std::make_unique<Camera>(Camera(look_from, look_at, view_up, field_of_view, aspect,
-                                                          aperture, distance_to_focus, time0, time1));
+    const CameraSettings camera_settings{look_from, look_at, view_up, field_of_view, aperture, distance_to_focus,
+                                         time0, time1};
+    auto current_camera = camera_settings.create(x_pixels, y_pixels);
 
     // World.
     const auto light_texture = std::make_shared<ConstantTexture>(ConstantTexture(Color3(1.0, 1.0, 1.0)));
@@ -130,7 +160,7 @@ Scene perlin_noise_demonstration(int x_pixels, int y_pixels, int maximum_recursi
             NoiseTexture(/*scale=*/4, /*turbulence_depth=*/7, Perlin(/*num_permutations=*/256)))));
 
     const int num_hittables = 3;
-    auto hittable_list = std::make_unique<HittableWorld>(HittableWorld(num_hittables));
+    auto hittable_list = std::make_shared<HittableWorld>(HittableWorld(num_hittables));
 
     // Sphere.
     hittable_list->add(std::make_shared<Sphere>(Sphere(BoundVec3(0.0, 2.0, 0.0), 2.0,
@@ -145,7 +175,9 @@ Scene perlin_noise_demonstration(int x_pixels, int y_pixels, int maximum_recursi
     hittable_list->add(rectangular_light);
 
     return Scene{.camera=std::move(current_camera),
-            .world=std::move(hittable_list),
+            .camera_settings=camera_settings,
+            .world=hittable_list,
+            .hittables=hittable_list,
             .maximum_recursion_depth=maximum_recursion_depth};
 }
 
@@ -159,13 +191,13 @@ Scene boxes(int x_pixels, int y_pixels, int maximum_recursion_depth) {
     const value_type field_of_view = 40.0;
     const value_type time0 = 0.0;
     const value_type time1 = 1.0;
-    const value_type aspect = value_type(x_pixels) / value_type(y_pixels);
-    auto current_camera = std::make_unique<Camera>(Camera(look_from, look_at, view_up, field_of_view, aspect,
-                                                          aperture, distance_to_focus, time0, time1));
+    const CameraSettings camera_settings{look_from, look_at, view_up, field_of_view, aperture, distance_to_focus,
+                                         time0, time1};
+    auto current_camera = camera_settings.create(x_pixels, y_pixels);
 
     // World.
     const int num_hittables = 40;
-    auto hittable_list = std::make_unique<HittableWorld>(HittableWorld(num_hittables));
+    auto hittable_list = std::make_shared<HittableWorld>(HittableWorld(num_hittables));
 
     const auto light_texture = std::make_shared<ConstantTexture>(ConstantTexture(Color3(1.0, 1.0, 1.0)));
     const auto light = std::make_shared<DiffuseLight>(DiffuseLight(light_texture));
@@ -189,8 +221,69 @@ Scene boxes(int x_pixels, int y_pixels, int maximum_recursion_depth) {
         }
     }
 
+    // With this many blocks, testing each one for every ray dominates the render time.
+    auto hierarchy = std::make_shared<LinearBoundingVolumeHierarchy>(*hittable_list, time0, time1);
+
+    return Scene{.camera=std::move(current_camera),
+            .camera_settings=camera_settings,
+            .world=hierarchy,
+            .hittables=hittable_list,
+            .maximum_recursion_depth=maximum_recursion_depth};
+}
+
+// Demonstrates instancing: a thousand rotated copies of a single octahedron mesh, lit from above.
+// The copies share the mesh, and a hierarchy is built over the instances themselves.
+Scene instanced_octahedra(int x_pixels, int y_pixels, int maximum_recursion_depth) {
+    // Positionable camera.
+    const BoundVec3 look_from(18.0, 14.0, -16.0);
+    const FreeVec3 look_at(4.5, 4.5, 4.5);
+    const FreeVec3 view_up(0.0, 1.0, 0.0);
+    const value_type distance_to_focus = 10.0;
+    const value_type aperture = 0.0;
+    const value_type field_of_view = 40.0;
+    const value_type time0 = 0.0;
+    const value_type time1 = 1.0;
+    const CameraSettings camera_settings{look_from, look_at, view_up, field_of_view, aperture, distance_to_focus,
+                                         time0, time1};
+    auto current_camera = camera_settings.create(x_pixels, y_pixels);
+
+    // World.
+    const int number_per_side = 10;
+    auto hittable_list = std::make_shared<HittableWorld>(
+            HittableWorld(number_per_side * number_per_side * number_per_side + 1));
+
+    const auto light_texture = std::make_shared<ConstantTexture>(ConstantTexture(Color3(4.0, 4.0, 4.0)));
+    const auto light = std::make_shared<DiffuseLight>(DiffuseLight(light_texture));
+    const auto gold = std::make_shared<Metal>(Metal(Color3(0.8, 0.6, 0.2), /*fuzz=*/0.3));
+
+    const std::vector<BoundVec3> positions = {
+            BoundVec3(0.3, 0.0, 0.0), BoundVec3(-0.3, 0.0, 0.0), BoundVec3(0.0, 0.3, 0.0),
+            BoundVec3(0.0, -0.3, 0.0), BoundVec3(0.0, 0.0, 0.3), BoundVec3(0.0, 0.0, -0.3)};
+    const std::vector<int> indices = {0, 2, 4,  2, 1, 4,  1, 3, 4,  3, 0, 4,
+                                      2, 0, 5,  1, 2, 5,  3, 1, 5,  0, 3, 5};
+    const auto octahedron = std::make_shared<TriangleMesh>(TriangleMesh(positions, indices, gold));
+
+    for (int i = 0; i < number_per_side; ++i) {
+        for (int j = 0; j < number_per_side; ++j) {
+            for (int k = 0; k < number_per_side; ++k) {
+                const AffineTransform transform = AffineTransform::translation(FreeVec3(i, j, k))
+                        * AffineTransform::rotation_y(360.0 * random_value())
+                        * AffineTransform::rotation_x(360.0 * random_value());
+                hittable_list->add(std::make_shared<Instance>(Instance(octahedron, transform)));
+            }
+        }
+    }
+
+    // Rectangular light source.
+    hittable_list->add(std::make_shared<FlipNormals>(FlipNormals(
+            std::make_shared<Rectangle_XZ>(Rectangle_XZ(-5.0, 15.0, -5.0, 15.0, 20.0, light)))));
+
+    auto hierarchy = std::make_shared<LinearBoundingVolumeHierarchy>(*hittable_list, time0, time1);
+
     return Scene{.camera=std::move(current_camera),
-            .world=std::move(hittable_list),
+            .camera_settings=camera_settings,
+            .world=hierarchy,
+            .hittables=hittable_list,
             .maximum_recursion_depth=maximum_recursion_depth};
 }
 
@@ -0,0 +1,404 @@
+#ifndef RAYTRACING_SCENEFILE_H
+#define RAYTRACING_SCENEFILE_H
+#include "Scene.h"
+#include "../utility/MeshImport.h"
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// A scene file describes a Scene as text, so that it can be changed without recompiling. Each line holds one
+// statement: a keyword followed by its arguments, separated by spaces or tabs. '#' starts a comment that runs
+// to the end of the line. Names are defined before they are used.
+//
+// Render settings (each optional; see SceneFileSettings):
+//     image WIDTH HEIGHT
+//     samples SAMPLES_PER_PIXEL
+//     max_depth MAXIMUM_RECURSION_DEPTH
+//     seed SEED
+// Camera (every key optional, defaulting to the values shown):
+//     camera look_from 0 0 0 look_at 0 0 -1 view_up 0 1 0 field_of_view 40 aperture 0 focus_distance 10 time 0 1
+// Textures:
+//     texture NAME constant R G B
+//     texture NAME checker ODD_TEXTURE EVEN_TEXTURE
+//     texture NAME noise TURBULENCE_DEPTH SCALE
+// Materials:
+//     material NAME lambertian TEXTURE
+//     material NAME metal R G B FUZZ
+//     material NAME dielectric air|glass_lower|glass_mid|glass_high|diamond
+//     material NAME light TEXTURE
+// Primitives, each added to the world:
+//     sphere CX CY CZ RADIUS MATERIAL
+//     rect_xy X0 X1 Y0 Y1 Z MATERIAL
+//     rect_xz X0 X1 Z0 Z1 Y MATERIAL
+//     rect_yz Y0 Y1 Z0 Z1 X MATERIAL
+//     block X0 Y0 Z0 X1 Y1 Z1 MATERIAL
+//     triangle AX AY AZ BX BY BZ CX CY CZ MATERIAL
+//     pyramid BASE_X BASE_Y BASE_Z HEIGHT MATERIAL
+//     mesh MESH_FILE MATERIAL
+//     instance OBJECT
+// followed by any number of modifiers, applied in the order given:
+//     flip  translate X Y Z  rotate_x DEGREES  rotate_y DEGREES  rotate_z DEGREES  scale X Y Z
+// Transformations are combined into one Instance of the primitive. A primitive can instead be defined as an
+// object, not added to the world itself, whose instances share it:
+//     object NAME PRIMITIVE...
+// A mesh is a TriangleMesh loaded from a Wavefront OBJ or binary PLY file (see MeshImporter), whose path is
+// relative to the directory of the scene file.
+// Acceleration (default auto, which builds a hierarchy over more than 8 primitives):
+//     accelerate none|lbvh|auto
+
+// The settings a scene file may set besides the scene. Each keeps its given value unless the file sets it.
+struct SceneFileSettings {
+    int x_pixels = 200;
+    int y_pixels = 200;
+    int samples_per_pixel = 50;
+    int maximum_recursion_depth = 50;
+    uint64_t seed = 0;
+    // Set by load_scene: the seconds taken to read the file and build the scene.
+    double load_seconds = 0.0;
+    // Set by load_scene: a hash of the text of the file, which identifies the scene (e.g. in checkpoints).
+    uint64_t scene_hash = 0;
+};
+
+// Parses the text of a scene file in a single pass over its lines. Tokens are views into the text, and names
+// are looked up by those views, so apart from the scene's own objects, parsing allocates next to nothing.
+class SceneFileParser {
+public:
+    // 'source' names the text in error messages, e.g. its file name. Both must outlive the parser.
+    SceneFileParser(std::string_view text, std::string_view source) : text_{text}, source_{source} {}
+
+    // Builds the scene, and updates 'settings' with the render settings of the file.
+    // Throws std::invalid_argument, naming the line, if the text is not a valid scene.
+    Scene parse(SceneFileSettings& settings) {
+        while (next_line()) {
+            const std::string_view keyword = next_token();
+            if (keyword.empty()) continue;
+            if (keyword == "image") {
+                settings.x_pixels = positive_integer();
+                settings.y_pixels = positive_integer();
+            } else if (keyword == "samples") {
+                settings.samples_per_pixel = positive_integer();
+            } else if (keyword == "max_depth") {
+                settings.maximum_recursion_depth = positive_integer();
+            } else if (keyword == "seed") {
+                settings.seed = uint64_t(integer());
+            } else if (keyword == "camera") {
+                parse_camera();
+            } else if (keyword == "texture") {
+                const std::string_view name = required_token("a texture name");
+                textures_[name] = parse_texture();
+            } else if (keyword == "material") {
+                const std::string_view name = required_token("a material name");
+                materials_[name] = parse_material();
+            } else if (keyword == "object") {
+                const std::string_view name = required_token("an object name");
+                objects_[name] = parse_primitive(required_token("a primitive"));
+            } else if (keyword == "accelerate") {
+                acceleration_ = required_token("none, lbvh, or auto");
+                if (acceleration_ != "none" && acceleration_ != "lbvh" && acceleration_ != "auto") {
+                    fail("Unknown acceleration '" + std::string(acceleration_) + "'.");
+                }
+            } else {
+                hittables_->add(parse_primitive(keyword));
+            }
+            if (!next_token().empty()) fail("Unexpected arguments at the end of the line.");
+        }
+
+        const bool accelerate = acceleration_ == "lbvh" || (acceleration_ == "auto" && hittables_->hittables().size() > 8);
+        std::shared_ptr<const Hittable> world = hittables_;
+        if (accelerate && !hittables_->hittables().empty()) {
+            world = std::make_shared<LinearBoundingVolumeHierarchy>(*hittables_, camera_.time0, camera_.time1);
+        }
+        return Scene{.camera=camera_.create(settings.x_pixels, settings.y_pixels),
+                     .camera_settings=camera_,
+                     .world=world,
+                     .hittables=hittables_,
+                     .maximum_recursion_depth=settings.maximum_recursion_depth};
+    }
+
+private:
+    // Moves to the next line, without its comment. Returns false at the end of the text.
+    bool next_line() {
+        if (position_ >= text_.size()) return false;
+        std::size_t end = text_.find('\n', position_);
+        if (end == std::string_view::npos) end = text_.size();
+        line_ = text_.substr(position_, end - position_);
+        const std::size_t comment = line_.find('#');
+        if (comment != std::string_view::npos) line_ = line_.substr(0, comment);
+        position_ = end + 1;
+        ++line_number_;
+        return true;
+    }
+
+    // The next token of the line, or an empty view at its end.
+    std::string_view next_token() {
+        std::size_t begin = 0;
+        while (begin < line_.size() && is_space(line_[begin])) ++begin;
+        std::size_t end = begin;
+        while (end < line_.size() && !is_space(line_[end])) ++end;
+        const std::string_view token = line_.substr(begin, end - begin);
+        line_ = line_.substr(end);
+        return token;
+    }
+
+    static bool is_space(char character) {
+        return character == ' ' || character == '\t' || character == '\r';
+    }
+
+    std::string_view required_token(const char* expected) {
+        const std::string_view token = next_token();
+        if (token.empty()) fail(std::string("Expected ") + expected + ".");
+        return token;
+    }
+
+    value_type number() {
+        const std::string_view token = required_token("a number");
+        value_type value = 0.0;
+        const auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+            fail("Expected a number rather than '" + std::string(token) + "'.");
+        }
+        return value;
+    }
+
+    long long integer() {
+        const std::string_view token = required_token("an integer");
+        long long value = 0;
+        const auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+            fail("Expected an integer rather than '" + std::string(token) + "'.");
+        }
+        return value;
+    }
+
+    int positive_integer() {
+        const long long value = integer();
+        if (value <= 0 || value > (1 << 30)) fail("Expected a positive integer.");
+        return int(value);
+    }
+
+    FreeVec3 vector() {
+        const value_type x = number();
+        const value_type y = number();
+        const value_type z = number();
+        return FreeVec3(x, y, z);
+    }
+
+    BoundVec3 point() { return BoundVec3(vector()); }
+
+    Color3 color() {
+        const value_type r = number();
+        const value_type g = number();
+        const value_type b = number();
+        return Color3(r, g, b);
+    }
+
+    // The value named by the next token in 'values', whose kind is 'kind'.
+    template<typename T>
+    T lookup(const std::unordered_map<std::string_view, T>& values, const char* kind) {
+        const std::string_view name = required_token(kind);
+        const auto found = values.find(name);
+        if (found == values.end()) fail(std::string("Unknown ") + kind + " '" + std::string(name) + "'.");
+        return found->second;
+    }
+
+    void parse_camera() {
+        for (std::string_view key = next_token(); !key.empty(); key = next_token()) {
+            if (key == "look_from") camera_.look_from = point();
+            else if (key == "look_at") camera_.look_at = vector();
+            else if (key == "view_up") camera_.view_up = vector();
+            else if (key == "field_of_view") camera_.field_of_view = number();
+            else if (key == "aperture") camera_.aperture = number();
+            else if (key == "focus_distance") camera_.focus_distance = number();
+            else if (key == "time") {
+                camera_.time0 = number();
+                camera_.time1 = number();
+            } else fail("Unknown camera setting '" + std::string(key) + "'.");
+        }
+    }
+
+    std::shared_ptr<const Texture> parse_texture() {
+        const std::string_view kind = required_token("a kind of texture");
+        if (kind == "constant") return std::make_shared<ConstantTexture>(ConstantTexture(color()));
+        if (kind == "checker") {
+            const auto odd = lookup(textures_, "texture");
+            const auto even = lookup(textures_, "texture");
+            return std::make_shared<CheckerTexture>(CheckerTexture(odd, even));
+        }
+        if (kind == "noise") {
+            const int turbulence_depth = positive_integer();
+            const int scale = int(integer());
+            return std::make_shared<NoiseTexture>(NoiseTexture(turbulence_depth, scale, Perlin(/*num_permutations=*/256)));
+        }
+        fail("Unknown kind of texture '" + std::string(kind) + "'.");
+    }
+
+    std::shared_ptr<Material> parse_material() {
+        const std::string_view kind = required_token("a kind of material");
+        if (kind == "lambertian") return std::make_shared<Lambertian>(Lambertian(lookup(textures_, "texture")));
+        if (kind == "light") return std::make_shared<DiffuseLight>(DiffuseLight(lookup(textures_, "texture")));
+        if (kind == "metal") {
+            const Color3 albedo = color();
+            return std::make_shared<Metal>(Metal(albedo, /*fuzz=*/number()));
+        }
+        if (kind == "dielectric") {
+            const std::string_view index = required_token("a refractive index");
+            if (index == "air") return std::make_shared<Dielectric>(Dielectric(AIR));
+            if (index == "glass_lower") return std::make_shared<Dielectric>(Dielectric(GLASS_LOWER));
+            if (index == "glass_mid") return std::make_shared<Dielectric>(Dielectric(GLASS_MID));
+            if (index == "glass_high") return std::make_shared<Dielectric>(Dielectric(GLASS_HIGH));
+            if (index == "diamond") return std::make_shared<Dielectric>(Dielectric(DIAMOND));
+            fail("Unknown refractive index '" + std::string(index) + "'.");
+        }
+        fail("Unknown kind of material '" + std::string(kind) + "'.");
+    }
+
+    // Parses the arguments of the primitive 'kind', and any modifiers after them.
+    std::shared_ptr<const Hittable> parse_primitive(std::string_view kind) {
+        std::shared_ptr<const Hittable> hittable;
+        if (kind == "sphere") {
+            const BoundVec3 center = point();
+            const value_type radius = number();
+            hittable = std::make_shared<Sphere>(Sphere(center, radius, lookup(materials_, "material")));
+        } else if (kind == "rect_xy" || kind == "rect_xz" || kind == "rect_yz") {
+            value_type bounds[5];
+            for (value_type& bound : bounds) bound = number();
+            const auto material = lookup(materials_, "material");
+            if (kind == "rect_xy") {
+                hittable = std::make_shared<Rectangle_XY>(Rectangle_XY(bounds[0], bounds[1], bounds[2], bounds[3],
+                                                                       bounds[4], material));
+            } else if (kind == "rect_xz") {
+                hittable = std::make_shared<Rectangle_XZ>(Rectangle_XZ(bounds[0], bounds[1], bounds[2], bounds[3],
+                                                                       bounds[4], material));
+            } else {
+                hittable = std::make_shared<Rectangle_YZ>(Rectangle_YZ(bounds[0], bounds[1], bounds[2], bounds[3],
+                                                                       bounds[4], material));
+            }
+        } else if (kind == "block") {
+            const BoundVec3 p0 = point();
+            const BoundVec3 p1 = point();
+            hittable = std::make_shared<Block>(Block(p0, p1, lookup(materials_, "material")));
+        } else if (kind == "triangle") {
+            const BoundVec3 a = point();
+            const BoundVec3 b = point();
+            const BoundVec3 c = point();
+            hittable = std::make_shared<Triangle>(Triangle(a, b, c, lookup(materials_, "material")));
+        } else if (kind == "pyramid") {
+            const BoundVec3 base = point();
+            const int height = positive_integer();
+            hittable = std::make_shared<SquarePyramid_XZ>(SquarePyramid_XZ(base, height, lookup(materials_, "material")));
+        } else if (kind == "mesh") {
+            const std::string path = relative_path(required_token("a mesh file"));
+            const auto material = lookup(materials_, "material");
+            // Meshes are loaded one after another, each split into parts parsed in parallel on threads that are
+            // started for the first mesh and kept for the rest.
+            if (!mesh_importer_) mesh_importer_ = std::make_unique<MeshImporter>();
+            MeshData mesh;
+            try {
+                mesh = mesh_importer_->load(path);
+            } catch (const std::invalid_argument& error) {
+                fail(error.what());
+            }
+            hittable = std::make_shared<TriangleMesh>(TriangleMesh(std::move(mesh.positions), std::move(mesh.indices),
+                                                                   material, std::move(mesh.normals),
+                                                                   std::move(mesh.uvs)));
+        } else if (kind == "instance") {
+            hittable = lookup(objects_, "object");
+        } else {
+            fail("Unknown statement '" + std::string(kind) + "'.");
+        }
+        return parse_modifiers(hittable);
+    }
+
+    // Applies the modifiers left on the line to 'hittable'.
+    std::shared_ptr<const Hittable> parse_modifiers(std::shared_ptr<const Hittable> hittable) {
+        AffineTransform transform;
+        bool is_transformed = false;
+        for (std::string_view modifier = next_token(); !modifier.empty(); modifier = next_token()) {
+            if (modifier == "flip") {
+                if (is_transformed) {
+                    hittable = std::make_shared<Instance>(Instance(hittable, transform));
+                    transform = AffineTransform();
+                    is_transformed = false;
+                }
+                hittable = std::make_shared<FlipNormals>(FlipNormals(hittable));
+                continue;
+            }
+            if (modifier == "translate") transform = AffineTransform::translation(vector()) * transform;
+            else if (modifier == "rotate_x") transform = AffineTransform::rotation_x(number()) * transform;
+            else if (modifier == "rotate_y") transform = AffineTransform::rotation_y(number()) * transform;
+            else if (modifier == "rotate_z") transform = AffineTransform::rotation_z(number()) * transform;
+            else if (modifier == "scale") {
+                const FreeVec3 factors = vector();
+                transform = AffineTransform::scaling(factors.x(), factors.y(), factors.z()) * transform;
+            } else fail("Unknown modifier '" + std::string(modifier) + "'.");
+            is_transformed = true;
+        }
+        if (is_transformed) hittable = std::make_shared<Instance>(Instance(hittable, transform));
+        return hittable;
+    }
+
+    // 'path' as seen from the directory of the source, if the source names a file in another directory.
+    std::string relative_path(std::string_view path) const {
+        const std::size_t slash = source_.rfind('/');
+        if (path.empty() || path.front() == '/' || slash == std::string_view::npos) return std::string(path);
+        return std::string(source_.substr(0, slash + 1)) + std::string(path);
+    }
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::invalid_argument(std::string(source_) + ":" + std::to_string(line_number_) + ": " + message);
+    }
+
+    std::string_view text_;
+    std::string_view source_;
+    // The position of the next line in the text, and the rest of the current line.
+    std::size_t position_ = 0;
+    std::string_view line_;
+    int line_number_ = 0;
+
+    CameraSettings camera_{BoundVec3(0.0, 0.0, 0.0), FreeVec3(0.0, 0.0, -1.0), FreeVec3(0.0, 1.0, 0.0),
+                           /*field_of_view=*/40.0, /*aperture=*/0.0, /*focus_distance=*/10.0,
+                           /*time0=*/0.0, /*time1=*/1.0};
+    std::unordered_map<std::string_view, std::shared_ptr<const Texture>> textures_;
+    std::unordered_map<std::string_view, std::shared_ptr<Material>> materials_;
+    std::unordered_map<std::string_view, std::shared_ptr<const Hittable>> objects_;
+    std::shared_ptr<HittableWorld> hittables_ = std::make_shared<HittableWorld>();
+    std::string_view acceleration_ = "auto";
+    std::unique_ptr<MeshImporter> mesh_importer_;
+};
+
+// Builds the scene described by the text of a scene file; see SceneFileParser.
+inline Scene parse_scene(std::string_view text, SceneFileSettings& settings, std::string_view source = "scene") {
+    return SceneFileParser(text, source).parse(settings);
+}
+
+// Loads the scene file 'path', updating 'settings' with its render settings and the time taken to load it.
+// The 64-bit FNV-1a hash of 'text'.
+inline uint64_t text_hash(std::string_view text) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char character : text) {
+        hash = (hash ^ uint8_t(character)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+inline Scene load_scene(const std::string& path, SceneFileSettings& settings) {
+    const auto start = std::chrono::steady_clock::now();
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("\nError opening the scene file " + path + ".");
+    }
+    const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    Scene scene = parse_scene(text, settings, path);
+    settings.scene_hash = text_hash(text);
+    settings.load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return scene;
+}
+
+#endif //RAYTRACING_SCENEFILE_H
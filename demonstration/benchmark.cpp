@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../utility/Vec3.h"
+#include "../utility/RayPacket.h"
+#include "../surfaces/HittableWorld.h"
+#include "../surfaces/acceleration/BoundingVolumeHierarchy.h"
+#include "../surfaces/acceleration/LinearBoundingVolumeHierarchy.h"
+#include "../surfaces/acceleration/TraversalStatistics.h"
+#include "../surfaces/acceleration/UniformGrid.h"
+#include "../surfaces/acceleration/WideBoundingVolumeHierarchy.h"
+#include "Scene.h"
+
+// An acceleration structure to benchmark, and how to build it over a scene's hittables.
+struct Accelerator {
+    std::string name;
+    std::function<std::shared_ptr<const Hittable>(const HittableWorld&)> build;
+};
+
+// A scene to benchmark, produced at the benchmark resolution.
+struct BenchmarkScene {
+    std::string name;
+    std::function<Scene(int, int, int)> create;
+};
+
+// Prints one line of results.
+void report(const std::string& scene, const std::string& structure, double build_ms, double seconds,
+            size_t num_rays, long long hits) {
+    const long long nodes_visited = traversal_statistics().nodes_visited;
+    std::printf("%-28s %-44s %10.2f %10.3f %12.2f %12.3f %10lld\n", scene.c_str(), structure.c_str(), build_ms,
+                num_rays / seconds / 1e6, double(nodes_visited) / num_rays, nodes_visited / seconds / 1e6, hits);
+}
+
+// Builds a LinearBVHTree over 'count' small boxes scattered through a cube with each build method,
+// and reports the build time and the surface area heuristic cost of the resulting tree.
+void benchmark_builds(int count) {
+    std::vector<BuildPrimitive> primitives;
+    primitives.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const BoundVec3 corner(random_value(), random_value(), random_value());
+        const FreeVec3 size(0.01 * random_value(), 0.01 * random_value(), 0.01 * random_value());
+        const AxisAlignedBoundingBox box(corner, corner + size);
+        primitives.push_back(BuildPrimitive{box, box.centroid(), i});
+    }
+    const std::vector<std::pair<std::string, BVH_BUILD_METHOD>> methods = {
+            {"surface area heuristic", SURFACE_AREA_HEURISTIC},
+            {"Morton code", MORTON_CODE},
+    };
+    std::printf("\n%-28s %-44s %10s %10s\n", "primitives", "build method", "build ms", "SAH cost");
+    for (const auto& method : methods) {
+        const auto build_start = std::chrono::steady_clock::now();
+        const LinearBVHTree tree(primitives, method.second);
+        const auto build_end = std::chrono::steady_clock::now();
+        std::printf("%-28d %-44s %10.2f %10.2f\n", count, method.first.c_str(),
+                    std::chrono::duration<double, std::milli>(build_end - build_start).count(),
+                    tree.surface_area_heuristic_cost());
+    }
+}
+
+// Traces the same set of primary camera rays through each acceleration structure built over
+// each demonstration scene, and reports the closest-hit throughput in rays and tree nodes
+// visited per second. Each structure is timed tracing the rays one at a time, in packets
+// holding the samples of one pixel, and as any-hit occlusion queries. Finally, the tree builders
+// are timed on a large number of primitives.
+// Usage: raytracing_benchmark [x_pixels y_pixels samples [build_primitives]]
+int main(int argc, char* argv[]) {
+    const int x_pixels = argc > 3 ? std::atoi(argv[1]) : 200;
+    const int y_pixels = argc > 3 ? std::atoi(argv[2]) : 200;
+    const int num_samples = argc > 3 ? std::atoi(argv[3]) : 4;
+    const int build_primitives = argc > 4 ? std::atoi(argv[4]) : 1000000;
+    const value_type time0 = 0.0;
+    const value_type time1 = 1.0;
+
+    const std::vector<BenchmarkScene> scenes = {
+            {"cornell_box", cornell_box},
+            {"perlin_noise_demonstration", perlin_noise_demonstration},
+            {"boxes", boxes},
+            {"instanced_octahedra", instanced_octahedra},
+    };
+    const std::vector<Accelerator> accelerators = {
+            {"HittableWorld", [](const HittableWorld& world) {
+                return std::make_shared<HittableWorld>(world);
+            }},
+            {"BoundingVolumeHierarchy", [&](const HittableWorld& world) {
+                return std::make_shared<BoundingVolumeHierarchy>(world, time0, time1);
+            }},
+            {"LinearBoundingVolumeHierarchy", [&](const HittableWorld& world) {
+                return std::make_shared<LinearBoundingVolumeHierarchy>(world, time0, time1);
+            }},
+            {"WideBoundingVolumeHierarchy<4>", [&](const HittableWorld& world) {
+                return std::make_shared<WideBoundingVolumeHierarchy<4>>(world, time0, time1);
+            }},
+            {"WideBoundingVolumeHierarchy<8>", [&](const HittableWorld& world) {
+                return std::make_shared<WideBoundingVolumeHierarchy<8>>(world, time0, time1);
+            }},
+            {"UniformGrid", [&](const HittableWorld& world) {
+                return std::make_shared<UniformGrid>(world, time0, time1);
+            }},
+    };
+
+    std::printf("%-28s %-44s %10s %10s %12s %12s %10s\n", "scene", "structure", "build ms",
+                "Mrays/s", "nodes/ray", "Mnodes/s", "hits");
+    for (const BenchmarkScene& benchmark_scene : scenes) {
+        const Scene scene = benchmark_scene.create(x_pixels, y_pixels, /*maximum_recursion_depth=*/1);
+        std::vector<Ray> rays;
+        rays.reserve(x_pixels * y_pixels * num_samples);
+        for (int j = 0; j < y_pixels; ++j) {
+            for (int i = 0; i < x_pixels; ++i) {
+                for (int sample = 0; sample < num_samples; ++sample) {
+                    Sampler sampler(/*seed=*/0, j * x_pixels + i, sample);
+                    const value_type u = value_type(i + sampler.next_value()) / value_type(x_pixels);
+                    const value_type v = value_type(j + sampler.next_value()) / value_type(y_pixels);
+                    rays.push_back(scene.camera->getRay(u, v, sampler));
+                }
+            }
+        }
+
+        for (const Accelerator& accelerator : accelerators) {
+            const auto build_start = std::chrono::steady_clock::now();
+            const std::shared_ptr<const Hittable> world = accelerator.build(*scene.hittables);
+            const auto build_end = std::chrono::steady_clock::now();
+
+            traversal_statistics() = TraversalStatistics();
+            long long hits = 0;
+            const auto trace_start = std::chrono::steady_clock::now();
+            for (const Ray& ray : rays) {
+                HitRecord record;
+                if (world->hit(ray, /*minimum=*/value_type(0.001),
+                               /*maximum=*/std::numeric_limits<value_type>::max(), record)) {
+                    ++hits;
+                }
+            }
+            const auto trace_end = std::chrono::steady_clock::now();
+
+            const double build_ms = std::chrono::duration<double, std::milli>(build_end - build_start).count();
+            report(benchmark_scene.name, accelerator.name, build_ms,
+                   std::chrono::duration<double>(trace_end - trace_start).count(), rays.size(), hits);
+
+            traversal_statistics() = TraversalStatistics();
+            hits = 0;
+            const int packet_size = num_samples < max_packet_size ? num_samples : max_packet_size;
+            const auto packet_start = std::chrono::steady_clock::now();
+            for (int first = 0; first < rays.size(); first += packet_size) {
+                RayPacket packet;
+                for (int k = first; k < rays.size() && packet.size < packet_size; ++k) {
+                    packet.add(rays[k]);
+                }
+                value_type t_max[max_packet_size];
+                std::fill(t_max, t_max + packet.size, std::numeric_limits<value_type>::max());
+                HitRecord records[max_packet_size];
+                hits += __builtin_popcount(world->hit_packet(packet, packet.all(), value_type(0.001), t_max, records));
+            }
+            const auto packet_end = std::chrono::steady_clock::now();
+            report(benchmark_scene.name, accelerator.name + " (packets of " + std::to_string(packet_size) + ")",
+                   build_ms, std::chrono::duration<double>(packet_end - packet_start).count(), rays.size(), hits);
+
+            traversal_statistics() = TraversalStatistics();
+            hits = 0;
+            const auto occlusion_start = std::chrono::steady_clock::now();
+            for (const Ray& ray : rays) {
+                if (world->occluded(ray, /*minimum=*/value_type(0.001),
+                                    /*maximum=*/std::numeric_limits<value_type>::max())) {
+                    ++hits;
+                }
+            }
+            const auto occlusion_end = std::chrono::steady_clock::now();
+            report(benchmark_scene.name, accelerator.name + " (any hit)", build_ms,
+                   std::chrono::duration<double>(occlusion_end - occlusion_start).count(), rays.size(), hits);
+        }
+    }
+
+    benchmark_builds(build_primitives);
+}
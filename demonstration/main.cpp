@@ -1,54 +1,213 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <vector>
 #include "../utility/Vec3.h"
 #include "../surfaces/HittableWorld.h"
+#include "../utility/AccumulationBuffer.h"
 #include "../utility/Camera.h"
+#include "../utility/Framebuffer.h"
+#include "../utility/ImageOutput.h"
+#include "../utility/TileRenderer.h"
+#include "../utility/WavefrontRenderer.h"
 #include "Scene.h"
+#include "SceneFile.h"
 
-// A demonstration that generates a PPM file named "raytracing_demo.ppm"
+// A demonstration that generates an image file named "raytracing_demo" (with the extension of its format)
 // using the current Scene.
-int main() {
-    const int x_pixels = 200;
-    const int y_pixels = 200;
-
-    // The average number of samples, for antialiasing.
-    const int num_samples = 50;
+// Usage: raytracing [--format p3|p6|pfm|tiled] [--gamma GAMMA] [--exposure STOPS] [--tone-map clamp|reinhard|aces]
+//                   [--mapped] [--scene SCENE_FILE] [--worker INDEX COUNT tiles|samples PARTIAL_FILE]
+// The image is a binary PPM with a gamma of 2, clamped, unless the options say otherwise; see ImageSettings.
+// With --mapped, the rendering threads write each tile straight into the image file mapped into memory
+// (see MappedImageWriter), which takes binary PPM or PFM images.
+// With --scene, the scene is loaded from SCENE_FILE (see SceneFileParser), which may also set the resolution,
+// the number of samples, the maximum recursion depth, and the seed.
+// With --worker, the render is divided between COUNT worker processes, by tile or by sample ranges,
+// and this process renders share INDEX (from 0) into PARTIAL_FILE rather than writing an image.
+// raytracing_merge then combines the partial files of all the workers into the image.
+int main(int argc, char* argv[]) {
+    // The resolution, the average number of samples (for antialiasing), and the maximum recursion depth allowed
+    // for coloring, unless a scene file sets them.
+    SceneFileSettings scene_settings;
+    scene_settings.x_pixels = 200;
+    scene_settings.y_pixels = 200;
+    scene_settings.samples_per_pixel = 50;
+    scene_settings.maximum_recursion_depth = 50;
 
     // 'max_color' represents the maximum color value.
     const int max_color = 255;
 
-    // The maximum recursion depth allowed for coloring.
-    const int maximum_depth = 50;
+    // The number of bounces after which paths may be ended early by Russian roulette.
+    const int russian_roulette_depth = 3;
 
-    // Scene.
-    const Scene scene = perlin_noise_demonstration(x_pixels, y_pixels, maximum_depth);
+    // The number of samples per pixel whose primary rays are traced together (at most 16).
+    // A packet size of 1 traces each ray on its own.
+    const int packet_size = 8;
+
+    // The number of rendering threads, where 0 uses every hardware thread.
+    const int thread_count = 0;
+
+    // Progressive rendering takes one sample of every pixel per pass, and saves the samples so far to
+    // 'checkpoint_path' at least 'checkpoint_interval' seconds apart. If the checkpoint file exists,
+    // the render resumes from it, e.g. after being interrupted or to add samples to a finished render.
+    const bool progressive = false;
+    const std::string checkpoint_path = "raytracing_demo.checkpoint";
+    const double checkpoint_interval = 60.0;
 
-    // Print to the file.
-    std::ofstream file;
-    file.open("raytracing_demo.ppm");
-    if (!file) {
-        throw std::runtime_error("\nError opening the file.");
+    // Adaptive sampling: if 'noise_threshold' is positive, each pixel takes between 'minimum_samples' and
+    // 'num_samples' samples, stopping once its noise is at most the threshold (where 1.0 is full brightness).
+    // The number of samples of each pixel is then also written to "raytracing_samples.pgm", where white is
+    // the most samples of any pixel. Adaptive sampling does not apply to progressive rendering.
+    const value_type noise_threshold = 0.0;
+    const int minimum_samples = 16;
+
+    // Renders with a WavefrontRenderer, which advances many paths at once stage by stage, rather than
+    // tile by tile. It takes neither packets nor adaptive sampling.
+    const bool wavefront = false;
+
+    // Time-budgeted rendering: if 'time_budget' is positive, the render takes about that many seconds, as many
+    // samples as fit (up to 'num_samples'), and the number of samples each pixel achieved is written to
+    // "raytracing_samples.pgm", where white is the most of any pixel.
+    const double time_budget = 0.0;
+
+    ImageSettings image_settings;
+    image_settings.post_process.max_color = max_color;
+    // The index of the first argument after --worker, if given.
+    int worker_arguments = 0;
+    bool mapped_output = false;
+    std::string scene_path;
+    for (int k = 1; k < argc; ) {
+        if (read_image_option(argc, argv, k, image_settings)) continue;
+        if (std::string(argv[k]) == "--mapped") {
+            mapped_output = true;
+            ++k;
+        } else if (std::string(argv[k]) == "--scene" && k + 1 < argc) {
+            scene_path = argv[k + 1];
+            k += 2;
+        } else if (std::string(argv[k]) == "--worker" && k + 4 < argc
+            && (std::string(argv[k + 3]) == "tiles" || std::string(argv[k + 3]) == "samples")) {
+            worker_arguments = k + 1;
+            k += 5;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " " << image_options_usage
+                      << " [--mapped] [--scene SCENE_FILE] [--worker INDEX COUNT tiles|samples PARTIAL_FILE]\n";
+            return 1;
+        }
     }
 
-    // PPM metadata.
-    file << "P3\n" ;
-    file << x_pixels << " " << y_pixels;
-    file << "\n" << max_color << "\n";
+    // Scene.
+    Scene scene = scene_path.empty()
+            ? perlin_noise_demonstration(scene_settings.x_pixels, scene_settings.y_pixels,
+                                         scene_settings.maximum_recursion_depth)
+            : load_scene(scene_path, scene_settings);
+    if (!scene_path.empty()) {
+        std::cout << "Loaded " << scene_path << " in " << scene_settings.load_seconds << " seconds.\n";
+    }
+    const int x_pixels = scene_settings.x_pixels;
+    const int y_pixels = scene_settings.y_pixels;
+    const int num_samples = scene_settings.samples_per_pixel;
+    // Identifies the render in checkpoint and partial files. The built-in scene is told apart from scene files by its name.
+    const AccumulationSource source{.seed=scene_settings.seed,
+                                    .scene=scene_path.empty() ? text_hash("perlin_noise_demonstration")
+                                                              : scene_settings.scene_hash};
 
-    // Top to bottom, left to right.
-    for (int j = y_pixels - 1; j >= 0; --j) {
-        for (int i = 0; i < x_pixels; ++i) {
-            Color3 current_color;
+    // Render the whole image before writing it out.
+    TileRenderer renderer(RenderSettings{.samples_per_pixel=num_samples,
+                                         .packet_size=packet_size,
+                                         .tile_size=16,
+                                         .thread_count=thread_count,
+                                         .seed=scene_settings.seed,
+                                         .russian_roulette_depth=russian_roulette_depth,
+                                         .checkpoint_interval=checkpoint_interval,
+                                         .noise_threshold=noise_threshold,
+                                         .minimum_samples_per_pixel=minimum_samples});
+    // Post-processes the image on the renderer's threads once it is rendered.
+    PostProcessor post_processor(renderer.pool());
+    if (worker_arguments > 0) {
+        char** worker_argv = argv + worker_arguments;
+        const RENDER_PARTITION partition = std::string(worker_argv[2]) == "tiles" ? TILE_RANGE : SAMPLE_RANGE;
+        const int worker = std::atoi(worker_argv[0]);
+        const int worker_count = std::atoi(worker_argv[1]);
+        // The partial file records its share, for raytracing_merge to check.
+        AccumulationBuffer share(x_pixels, y_pixels, source,
+                                 AccumulationShare{worker, worker_count, partition, num_samples});
+        renderer.render_share(scene.camera.get(), scene.world.get(), scene.maximum_recursion_depth, share,
+                              worker, worker_count, partition);
+        share.save(worker_argv[3]);
+        return 0;
+    }
+    const std::string image_path = "raytracing_demo" + image_extension(image_settings.format);
 
-            Camera::antialiasing(current_color, scene.camera.get(), scene.world.get(),
-                    num_samples, x_pixels, y_pixels, i, j, scene.maximum_recursion_depth);
-            Camera::dampen(current_color);
+    Framebuffer framebuffer(x_pixels, y_pixels);
+    // The number of samples of each pixel, written out after adaptive or time-budgeted rendering.
+    std::vector<int> sample_counts;
+    if (time_budget > 0.0) {
+        AccumulationBuffer accumulation(x_pixels, y_pixels);
+        const double seconds = renderer.render_budgeted(scene.camera.get(), scene.world.get(),
+                                                        scene.maximum_recursion_depth, accumulation, time_budget);
+        accumulation.resolve(framebuffer);
+        write_image(image_path, framebuffer, post_processor, image_settings);
+        for (int j = 0; j < y_pixels; ++j) {
+            for (int i = 0; i < x_pixels; ++i) {
+                sample_counts.push_back(int(accumulation.sample_count(i, j)));
+            }
+        }
+        std::cout << "Rendered " << *std::min_element(sample_counts.begin(), sample_counts.end()) << " to "
+                  << *std::max_element(sample_counts.begin(), sample_counts.end()) << " samples per pixel in "
+                  << seconds << " seconds.\n";
+    } else if (progressive) {
+        AccumulationBuffer accumulation = std::ifstream(checkpoint_path)
+                ? AccumulationBuffer::load(checkpoint_path) : AccumulationBuffer(x_pixels, y_pixels, source);
+        if (accumulation.width() != x_pixels || accumulation.height() != y_pixels) {
+            throw std::runtime_error("\nThe checkpoint is of an image with different dimensions.");
+        }
+        if (accumulation.source() != source) {
+            throw std::runtime_error("\nThe checkpoint is of another scene or seed.");
+        }
+        renderer.render_progressive(scene.camera.get(), scene.world.get(), scene.maximum_recursion_depth, accumulation,
+                                    [&](const AccumulationBuffer& samples) { samples.save(checkpoint_path); });
+        accumulation.resolve(framebuffer);
+        write_image(image_path, framebuffer, post_processor, image_settings);
+    } else if (wavefront) {
+        WavefrontRenderer(RenderSettings{.samples_per_pixel=num_samples,
+                                         .thread_count=thread_count,
+                                         .seed=scene_settings.seed,
+                                         .russian_roulette_depth=russian_roulette_depth})
+                .render(scene.camera.get(), scene.world.get(), scene.maximum_recursion_depth, framebuffer);
+        write_image(image_path, framebuffer, post_processor, image_settings);
+    } else if (mapped_output) {
+        // Each tile is written into the file by the thread that rendered it.
+        MappedImageWriter writer(image_path, framebuffer, image_settings);
+        renderer.render(scene.camera.get(), scene.world.get(), scene.maximum_recursion_depth, framebuffer,
+                        &sample_counts, [&](int i_begin, int i_end, int j_begin, int j_end) {
+                            writer.tile_finished(i_begin, i_end, j_begin, j_end);
+                        });
+        writer.finish();
+        if (noise_threshold <= 0.0) sample_counts.clear();
+    } else {
+        // Rows are written out as soon as they are rendered, while the rest of the image is still rendering.
+        AsyncImageWriter writer(image_path, framebuffer, image_settings);
+        renderer.render(scene.camera.get(), scene.world.get(), scene.maximum_recursion_depth, framebuffer,
+                        &sample_counts, [&](int i_begin, int i_end, int j_begin, int j_end) {
+                            writer.tile_finished(i_begin, i_end, j_begin, j_end);
+                        });
+        writer.finish();
+        if (noise_threshold <= 0.0) sample_counts.clear();
+    }
 
-            const int i_red = int(max_color * current_color.r());
-            const int i_green = int(max_color * current_color.g());
-            const int i_blue = int(max_color * current_color.b());
-            file << i_red << " " << i_green << " " << i_blue << "\n";
+    if (!sample_counts.empty()) {
+        std::ofstream sample_map("raytracing_samples.pgm");
+        if (!sample_map) {
+            throw std::runtime_error("\nError opening the sample map file.");
+        }
+        const int most_samples = std::max(1, *std::max_element(sample_counts.begin(), sample_counts.end()));
+        sample_map << "P2\n" << x_pixels << " " << y_pixels << "\n" << max_color << "\n";
+        for (int j = y_pixels - 1; j >= 0; --j) {
+            for (int i = 0; i < x_pixels; ++i) {
+                sample_map << max_color * sample_counts[j * x_pixels + i] / most_samples << "\n";
+            }
         }
     }
-    file.close();
-}
\ No newline at end of file
+}
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../utility/AccumulationBuffer.h"
+#include "../utility/Framebuffer.h"
+#include "../utility/ImageOutput.h"
+
+// Combines the partial files written by the worker processes of a divided render
+// (see raytracing --worker) into an image, a binary PPM with a gamma of 2 unless the options say otherwise.
+// Usage: raytracing_merge [IMAGE_OPTIONS] OUTPUT_IMAGE PARTIAL_FILE...
+// where IMAGE_OPTIONS are those of raytracing; see image_options_usage. The partial files must be distinct
+// shares of the same division of the same render, as recorded in each, or else nothing is written.
+int main(int argc, char* argv[]) {
+    ImageSettings image_settings;
+    int first = 1;
+    while (first < argc && read_image_option(argc, argv, first, image_settings)) {
+    }
+    if (argc - first < 2 || argv[first][0] == '-') {
+        std::cerr << "Usage: " << argv[0] << " " << image_options_usage << " OUTPUT_IMAGE PARTIAL_FILE...\n";
+        return 1;
+    }
+    AccumulationBuffer accumulation = AccumulationBuffer::load(argv[first + 1]);
+    const AccumulationShare division = accumulation.share();
+    // The file given for each share, so that a share given twice is caught rather than counted twice.
+    std::vector<std::string> share_paths(std::max(0, division.worker_count));
+    // Checks that the partial file 'path' holds another share of the same render as the first one.
+    const auto add_share = [&](const AccumulationBuffer& partial, const std::string& path) {
+        const AccumulationShare& share = partial.share();
+        if (partial.source() != accumulation.source() || !share.same_division(division)) {
+            throw std::runtime_error("\n" + path + " is not of the same render as " + argv[first + 1] + ".");
+        }
+        if (share.worker < 0 || share.worker >= share.worker_count) {
+            throw std::runtime_error("\n" + path + " is not a valid share of a render.");
+        }
+        if (!share_paths[share.worker].empty()) {
+            throw std::runtime_error("\n" + path + " holds the same share as " + share_paths[share.worker] + ".");
+        }
+        share_paths[share.worker] = path;
+    };
+    add_share(accumulation, argv[first + 1]);
+    for (int k = first + 2; k < argc; ++k) {
+        const AccumulationBuffer partial = AccumulationBuffer::load(argv[k]);
+        add_share(partial, argv[k]);
+        accumulation.merge(partial);
+    }
+    const long long shares_given = std::count_if(share_paths.begin(), share_paths.end(),
+                                                 [](const std::string& path) { return !path.empty(); });
+    if (shares_given < division.worker_count) {
+        std::cerr << "Warning: only " << shares_given << " of the " << division.worker_count
+                  << " shares of the render are given.\n";
+    }
+
+    // A worker whose file is missing leaves its pixels without samples.
+    int pixels_without_samples = 0;
+    for (int j = 0; j < accumulation.height(); ++j) {
+        for (int i = 0; i < accumulation.width(); ++i) {
+            if (accumulation.sample_count(i, j) == 0) ++pixels_without_samples;
+        }
+    }
+    if (pixels_without_samples > 0) {
+        std::cerr << "Warning: " << pixels_without_samples << " pixels have no samples, and are black.\n";
+    }
+
+    Framebuffer framebuffer(accumulation.width(), accumulation.height());
+    accumulation.resolve(framebuffer);
+    PostProcessor post_processor;
+    write_image(argv[first], framebuffer, post_processor, image_settings);
+}
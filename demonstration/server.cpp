@@ -0,0 +1,268 @@
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "../utility/Framebuffer.h"
+#include "../utility/ImageOutput.h"
+#include "../utility/TileRenderer.h"
+#include "Scene.h"
+#include "SceneFile.h"
+
+// A render server: loads a scene once, keeping its hittables, textures, and acceleration structures
+// in memory, and then renders jobs for it until told to quit, so that each job only pays for rendering.
+// Usage: raytracing_server SCENE [SOCKET_PATH]
+// where SCENE is one of cornell_box, perlin_noise, boxes, or instanced_octahedra, or else the path of a
+// scene file (see SceneFileParser), whose render settings other than its scene are ignored. Jobs are read from
+// standard input, or if SOCKET_PATH is given, from the clients of a UNIX socket created there, one
+// client at a time. Each job is a line
+//     render OUTPUT_PATH WIDTH HEIGHT SAMPLES [OPTION=VALUE...]
+// where the options override the scene's camera and the render settings:
+//     look_from=X,Y,Z look_at=X,Y,Z view_up=X,Y,Z field_of_view=DEGREES aperture=A focus_distance=D
+//     seed=N threads=N format=p3|p6|pfm|tiled gamma=GAMMA exposure=STOPS tone_map=clamp|reinhard|aces
+// and is answered with a line "ok OUTPUT_PATH SECONDS" once the image is written, or "error MESSAGE".
+// The rendering threads are kept from one job to the next, and only started again for a job whose
+// threads= differs from that of the job before.
+// The line "quit" stops the server.
+
+// Reads lines from a file descriptor.
+class LineReader {
+public:
+    explicit LineReader(int descriptor) : descriptor_{descriptor} {}
+
+    // Reads the next line, without its newline, into 'line'. Returns false at the end of the input.
+    bool read_line(std::string& line) {
+        while (true) {
+            const std::size_t newline = buffer_.find('\n');
+            if (newline != std::string::npos) {
+                line = buffer_.substr(0, newline);
+                buffer_.erase(0, newline + 1);
+                return true;
+            }
+            char chunk[4096];
+            const ssize_t count = read(descriptor_, chunk, sizeof(chunk));
+            if (count <= 0) {
+                // A last line without a newline still counts.
+                line = buffer_;
+                buffer_.clear();
+                return !line.empty();
+            }
+            buffer_.append(chunk, count);
+        }
+    }
+
+private:
+    int descriptor_;
+    std::string buffer_;
+};
+
+// Writes all of 'text' to a file descriptor.
+void write_all(int descriptor, const std::string& text) {
+    std::size_t written = 0;
+    while (written < text.size()) {
+        const ssize_t count = write(descriptor, text.data() + written, text.size() - written);
+        if (count <= 0) return; // The client went away; its job is done regardless.
+        written += count;
+    }
+}
+
+// Parses "X,Y,Z".
+FreeVec3 parse_vector(const std::string& text) {
+    FreeVec3 vector;
+    char comma1, comma2;
+    std::istringstream stream(text);
+    if (!(stream >> vector.x() >> comma1 >> vector.y() >> comma2 >> vector.z()) || comma1 != ',' || comma2 != ',') {
+        throw std::invalid_argument("Expected a vector X,Y,Z rather than '" + text + "'.");
+    }
+    return vector;
+}
+
+// Parses a number, which must make up all of 'text'.
+value_type parse_number(const std::string& text) {
+    std::size_t length = 0;
+    value_type number = 0.0;
+    try {
+        number = std::stod(text, &length);
+    } catch (const std::exception&) {
+    }
+    if (length == 0 || length != text.size()) {
+        throw std::invalid_argument("Expected a number rather than '" + text + "'.");
+    }
+    return number;
+}
+
+// Renders the job given by the words of a render line (after "render") with 'renderer', which is
+// replaced if the job asks for another number of threads, and returns the answer.
+std::string render_job(const Scene& scene, const std::vector<std::string>& words,
+                       std::unique_ptr<TileRenderer>& renderer) {
+    if (words.size() < 4) {
+        throw std::invalid_argument("Expected: render OUTPUT_PATH WIDTH HEIGHT SAMPLES [OPTION=VALUE...]");
+    }
+    const std::string& output_path = words[0];
+    const int x_pixels = int(parse_number(words[1]));
+    const int y_pixels = int(parse_number(words[2]));
+    RenderSettings settings;
+    settings.samples_per_pixel = int(parse_number(words[3]));
+    CameraSettings camera_settings = scene.camera_settings;
+    ImageSettings image_settings;
+    for (std::size_t k = 4; k < words.size(); ++k) {
+        const std::size_t equals = words[k].find('=');
+        if (equals == std::string::npos) {
+            throw std::invalid_argument("Expected OPTION=VALUE rather than '" + words[k] + "'.");
+        }
+        const std::string option = words[k].substr(0, equals);
+        const std::string value = words[k].substr(equals + 1);
+        if (option == "look_from") camera_settings.look_from = BoundVec3(parse_vector(value));
+        else if (option == "look_at") camera_settings.look_at = parse_vector(value);
+        else if (option == "view_up") camera_settings.view_up = parse_vector(value);
+        else if (option == "field_of_view") camera_settings.field_of_view = parse_number(value);
+        else if (option == "aperture") camera_settings.aperture = parse_number(value);
+        else if (option == "focus_distance") camera_settings.focus_distance = parse_number(value);
+        else if (option == "seed") settings.seed = uint64_t(parse_number(value));
+        else if (option == "threads") settings.thread_count = int(parse_number(value));
+        else if (!set_image_setting(image_settings, option, value)) {
+            throw std::invalid_argument("Unknown option '" + option + "'.");
+        }
+    }
+    if (settings.samples_per_pixel <= 0) {
+        throw std::invalid_argument("The number of samples must be positive.");
+    }
+
+    if (settings.thread_count == renderer->settings().thread_count) {
+        renderer->set_settings(settings);
+    } else {
+        renderer.reset();
+        renderer = std::make_unique<TileRenderer>(settings);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::unique_ptr<const Camera> camera = camera_settings.create(x_pixels, y_pixels);
+    Framebuffer framebuffer(x_pixels, y_pixels);
+    AsyncImageWriter writer(output_path, framebuffer, image_settings);
+    renderer->render(camera.get(), scene.world.get(), scene.maximum_recursion_depth, framebuffer,
+                     nullptr, [&](int i_begin, int i_end, int j_begin, int j_end) {
+                         writer.tile_finished(i_begin, i_end, j_begin, j_end);
+                     });
+    writer.finish();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return "ok " + output_path + " " + std::to_string(seconds) + "\n";
+}
+
+// Answers each job read from 'input' on 'output' with 'renderer', until the input ends or a "quit" line.
+// Returns false if told to quit.
+bool serve(const Scene& scene, int input, int output, std::unique_ptr<TileRenderer>& renderer) {
+    LineReader reader(input);
+    std::string line;
+    while (reader.read_line(line)) {
+        std::istringstream stream(line);
+        std::vector<std::string> words;
+        for (std::string word; stream >> word; ) {
+            words.push_back(word);
+        }
+        if (words.empty()) continue;
+        if (words[0] == "quit") return false;
+        std::string answer;
+        try {
+            if (words[0] != "render") {
+                throw std::invalid_argument("Unknown command '" + words[0] + "'.");
+            }
+            answer = render_job(scene, std::vector<std::string>(words.begin() + 1, words.end()), renderer);
+        } catch (const std::exception& error) {
+            answer = "error " + std::string(error.what()) + "\n";
+            // Messages meant for the console start with a newline; keep the answer on one line.
+            for (char& character : answer) {
+                if (character == '\n' && &character != &answer.back()) character = ' ';
+            }
+        }
+        write_all(output, answer);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const std::map<std::string, std::function<Scene(int, int, int)>> scenes = {
+            {"cornell_box", cornell_box},
+            {"perlin_noise", perlin_noise_demonstration},
+            {"boxes", boxes},
+            {"instanced_octahedra", instanced_octahedra}};
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " cornell_box|perlin_noise|boxes|instanced_octahedra|SCENE_FILE [SOCKET_PATH]\n";
+        return 1;
+    }
+    // A client that goes away before its answer is written should not stop the server.
+    std::signal(SIGPIPE, SIG_IGN);
+    // Each job creates its own camera, so the scene's resolution here does not matter.
+    Scene scene;
+    if (scenes.count(argv[1]) != 0) {
+        scene = scenes.at(argv[1])(1, 1, /*maximum_recursion_depth=*/50);
+    } else {
+        SceneFileSettings settings;
+        scene = load_scene(argv[1], settings);
+        std::cerr << "Loaded " << argv[1] << " in " << settings.load_seconds << " seconds.\n";
+    }
+
+    // One thread per hardware thread, until a job asks for another number.
+    std::unique_ptr<TileRenderer> renderer = std::make_unique<TileRenderer>(RenderSettings());
+
+    if (argc == 2) {
+        serve(scene, STDIN_FILENO, STDOUT_FILENO, renderer);
+        return 0;
+    }
+
+    const std::string socket_path = argv[2];
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "The socket path is too long.\n";
+        return 1;
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+    // A socket left behind by an earlier server is replaced, but any other file there is not touched,
+    // in case the path was given by mistake (e.g. that of an image).
+    struct stat existing{};
+    if (lstat(socket_path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            std::cerr << socket_path << " exists and is not a socket.\n";
+            return 1;
+        }
+        unlink(socket_path.c_str());
+    }
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct stat bound{};
+    if (listener < 0 || bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || lstat(socket_path.c_str(), &bound) != 0 || listen(listener, /*backlog=*/16) != 0) {
+        std::perror("Error creating the socket");
+        return 1;
+    }
+    bool serving = true;
+    while (serving) {
+        const int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::perror("Error accepting a client");
+            break;
+        }
+        serving = serve(scene, client, client, renderer);
+        close(client);
+    }
+    close(listener);
+    // Remove the socket only if it is still the one bound here, and not one another server has replaced.
+    struct stat current{};
+    if (lstat(socket_path.c_str(), &current) == 0 && S_ISSOCK(current.st_mode)
+        && current.st_dev == bound.st_dev && current.st_ino == bound.st_ino) {
+        unlink(socket_path.c_str());
+    }
+}
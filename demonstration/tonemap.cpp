@@ -0,0 +1,26 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "../utility/Framebuffer.h"
+#include "../utility/ImageOutput.h"
+
+// Writes a tiled float image, e.g. from raytracing --format tiled, which keeps the colors as rendered,
+// again as an image with other settings, e.g. another exposure or tone mapping, without rendering it again.
+// Usage: raytracing_tonemap [IMAGE_OPTIONS] INPUT_TILED_IMAGE OUTPUT_IMAGE
+// where IMAGE_OPTIONS are those of raytracing; see image_options_usage.
+int main(int argc, char* argv[]) {
+    ImageSettings image_settings;
+    int first = 1;
+    while (first < argc && read_image_option(argc, argv, first, image_settings)) {
+    }
+    if (argc - first != 2) {
+        std::cerr << "Usage: " << argv[0] << " " << image_options_usage << " INPUT_TILED_IMAGE OUTPUT_IMAGE\n";
+        return 1;
+    }
+    const Framebuffer framebuffer = read_tiled_image(argv[first]);
+    PostProcessor post_processor;
+    const auto start = std::chrono::steady_clock::now();
+    write_image(argv[first + 1], framebuffer, post_processor, image_settings);
+    std::cout << "Wrote " << argv[first + 1] << " in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " seconds.\n";
+}
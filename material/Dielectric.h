@@ -55,7 +55,7 @@ public:
     // solid object, also known as "total internal reflection."
     // Note also, that attenuation is always 1; a dielectric surface absorbs nothing.
     virtual bool scatter(const Ray& ray_in, const HitRecord& record,
-                         Color3& attenuation, Ray& scattered) const override {
+                         Color3& attenuation, Ray& scattered, Sampler& sampler) const override {
         UnitVec3 outward_normal;
         const UnitVec3 reflected = reflect(ray_in.direction(), record.normal);
         value_type ni_over_nt;
@@ -78,7 +78,7 @@ public:
         const bool is_refracted = refract(ray_in.direction(), outward_normal, ni_over_nt, refracted);
         reflect_probability = is_refracted ? schlick(cosine) : 1.0;
 
-       if (random_value() < reflect_probability) {
+       if (sampler.next_value() < reflect_probability) {
            scattered = Ray(record.point_at_parameter, reflected, ray_in.time());
        } else {
            scattered = Ray(record.point_at_parameter, refracted);
@@ -9,7 +9,7 @@ public:
     DiffuseLight(std::shared_ptr<const Texture> emit) : emit_{emit} {}
 
     virtual bool scatter(const Ray& ray_in, const HitRecord& record,
-                         Color3& attenuation, Ray& scattered) const override {
+                         Color3& attenuation, Ray& scattered, Sampler& sampler) const override {
         return false;
     }
 
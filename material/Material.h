@@ -2,6 +2,7 @@
 #define RAYTRACING_MATERIAL_H
 #include "../utility/Vec3.h"
 #include "../surfaces/Hittable.h"
+#include "../utility/Sampler.h"
 
 // Represents the behavior of material, or how a ray may react to certain materials.
 // If a material does not emit any light, it will emit black: Color3(0.0, 0.0, 0.0).
@@ -11,7 +12,9 @@ public:
     // 1. Produce a scattered ray (or the resulting absorption).
     // 2. If scattered, say how much the ray should be attenuated.
     // Simply put, this tells us how the the ray will interact with the surface.
-    [[nodiscard]] virtual bool scatter(const Ray& ray_in, const HitRecord& record, Color3& attenuation, Ray& scattered) const = 0;
+    // Any random numbers needed to scatter the ray are drawn from 'sampler'.
+    [[nodiscard]] virtual bool scatter(const Ray& ray_in, const HitRecord& record, Color3& attenuation, Ray& scattered,
+                                       Sampler& sampler) const = 0;
 
     // For smooth metals, rays will not be randomly scattered.
     // Instead, the metal is treated as a mirror, and we can
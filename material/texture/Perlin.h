@@ -87,8 +87,8 @@ public:
     std::vector<int> perlin_generate_permutation() {
         std::vector<int> p(num_permutations_);
         std::iota(p.begin(), p.end(), 0);
-        static std::random_device rd;
-        static std::mt19937 g(rd());
+        // Seeded from random_value() rather than std::random_device, so that scenes are reproducible.
+        std::mt19937 g(static_cast<std::mt19937::result_type>(random_value() * std::mt19937::max()));
         std::shuffle(p.begin(), p.end(), g);
         return p;
     }
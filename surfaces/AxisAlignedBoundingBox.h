@@ -2,11 +2,24 @@
 #define RAYTRACING_AXISALIGNEDBOUNDINGBOX_H
 #include "../utility/Vec3.h"
 #include "../utility/Ray.h"
+#include "../utility/RayPacket.h"
 
 // Avoids unnecessary checks such as NaN.
 inline value_type get_min(value_type a, value_type b) { return a < b ? a : b; }
 inline value_type get_max(value_type a, value_type b) { return a > b ? a : b; }
 
+// A ray prepared for testing against many boxes. The reciprocal of the direction,
+// and which way it points along each axis, are computed once rather than for every box.
+struct InverseRay {
+    explicit InverseRay(const Ray& ray) : origin{ray.origin()},
+            inverse_direction{1.0 / ray.direction().x(), 1.0 / ray.direction().y(), 1.0 / ray.direction().z()},
+            is_negative{ray.direction().x() < 0.0, ray.direction().y() < 0.0, ray.direction().z() < 0.0} {}
+
+    BoundVec3 origin;
+    FreeVec3 inverse_direction;
+    bool is_negative[3];
+};
+
 class AxisAlignedBoundingBox {
 public:
 
@@ -16,6 +29,16 @@ public:
     BoundVec3 min() const { return min_; }
     BoundVec3 max() const { return max_; }
 
+    // The midpoint of the box, used to order surfaces when building acceleration structures.
+    BoundVec3 centroid() const { return min_ + (max_ - min_) * 0.5; }
+
+    // The total area of the six faces. Under the surface area heuristic, this is proportional
+    // to the probability that a random ray passing through a parent box also passes through this one.
+    value_type surface_area() const {
+        const FreeVec3 extent = max_ - min_;
+        return 2.0 * (extent.x() * extent.y() + extent.y() * extent.z() + extent.z() * extent.x());
+    }
+
     static AxisAlignedBoundingBox surrounding_box(const AxisAlignedBoundingBox& box0, const AxisAlignedBoundingBox& box1) {
         const BoundVec3 small(get_min(box0.min().x(), box1.min().x()),
                               get_min(box0.min().y(), box1.min().y()),
@@ -40,6 +63,41 @@ public:
         return true;
     }
 
+    // The slab test above, without a division or a swap per axis.
+    bool hit(const InverseRay& ray, value_type t_min, value_type t_max) const {
+        const value_type tx0 = ((ray.is_negative[0] ? max_ : min_).x() - ray.origin.x()) * ray.inverse_direction.x();
+        const value_type tx1 = ((ray.is_negative[0] ? min_ : max_).x() - ray.origin.x()) * ray.inverse_direction.x();
+        const value_type ty0 = ((ray.is_negative[1] ? max_ : min_).y() - ray.origin.y()) * ray.inverse_direction.y();
+        const value_type ty1 = ((ray.is_negative[1] ? min_ : max_).y() - ray.origin.y()) * ray.inverse_direction.y();
+        const value_type tz0 = ((ray.is_negative[2] ? max_ : min_).z() - ray.origin.z()) * ray.inverse_direction.z();
+        const value_type tz1 = ((ray.is_negative[2] ? min_ : max_).z() - ray.origin.z()) * ray.inverse_direction.z();
+        // The slab distances come first so that a NaN (a ray lying in a slab plane) is ignored.
+        t_min = get_max(tz0, get_max(ty0, get_max(tx0, t_min)));
+        t_max = get_min(tz1, get_min(ty1, get_min(tx1, t_max)));
+        return t_min < t_max;
+    }
+
+    // Tests every ray of 'packet' in the mask 'active', where t_max[i] bounds ray i.
+    // Returns the mask of the active rays that hit the box. Every ray is computed without
+    // branches, and inactive ones are masked off afterwards, so the loop can be vectorized.
+    int hit(const RayPacket& packet, int active, value_type t_min, const value_type t_max[]) const {
+        int mask = 0;
+        for (int i = 0; i < packet.size; ++i) {
+            const value_type tx0 = (min_.x() - packet.origin_x[i]) * packet.inverse_direction_x[i];
+            const value_type tx1 = (max_.x() - packet.origin_x[i]) * packet.inverse_direction_x[i];
+            const value_type ty0 = (min_.y() - packet.origin_y[i]) * packet.inverse_direction_y[i];
+            const value_type ty1 = (max_.y() - packet.origin_y[i]) * packet.inverse_direction_y[i];
+            const value_type tz0 = (min_.z() - packet.origin_z[i]) * packet.inverse_direction_z[i];
+            const value_type tz1 = (max_.z() - packet.origin_z[i]) * packet.inverse_direction_z[i];
+            const value_type enter = get_max(get_min(tz0, tz1),
+                                             get_max(get_min(ty0, ty1), get_max(get_min(tx0, tx1), t_min)));
+            const value_type exit = get_min(get_max(tz0, tz1),
+                                            get_min(get_max(ty0, ty1), get_min(get_max(tx0, tx1), t_max[i])));
+            mask |= int(enter < exit) << i;
+        }
+        return mask & active;
+    }
+
 private:
     BoundVec3 min_;
     BoundVec3 max_;
@@ -1,52 +1,64 @@
 #ifndef RAYTRACING_BLOCK_H
 #define RAYTRACING_BLOCK_H
 #include "Hittable.h"
-#include "HittableWorld.h"
-#include "Rectangle_XZ.h"
-#include "Rectangle_XY.h"
-#include "Rectangle_YZ.h"
-#include "FlipNormals.h"
-
-// Represents an axis aligned block. Each of the 6 sides is a rectangle.
-// Currently, they will all share the same material.
+#include <array>
+#include <limits>
+#include <memory>
+#include <utility>
+
+// The six faces of a block. LEFT and RIGHT lie at the minimum and maximum x,
+// BOTTOM and TOP at the minimum and maximum y, and FRONT and BACK at the minimum and maximum z.
+enum BLOCK_FACE {
+    LEFT,
+    RIGHT,
+    BOTTOM,
+    TOP,
+    FRONT,
+    BACK
+};
+
+// Represents an axis aligned block. A ray is intersected with all six sides at once, as the
+// overlap of the three slabs between each pair of opposite sides. Normals point out of the block,
+// and each side has 2-dimensional texture coordinates like the axis aligned rectangle in its plane.
+// Each side may have its own material.
 class Block : public Hittable {
 public:
-    Block(const BoundVec3& p0, const BoundVec3& p1, std::shared_ptr<const Material> material) {
-        p_min_ = p0;
-        p_max_ = p1;
-
-        const value_type p0_x = p0.x();
-        const value_type p0_y = p0.y();
-        const value_type p0_z = p0.z();
-        const value_type p1_x = p1.x();
-        const value_type p1_y = p1.y();
-        const value_type p1_z = p1.z();
-
-        const auto front = std::make_shared<Rectangle_XY>
-                (Rectangle_XY(p0_x, p1_x, p0_y, p1_y, p0_z, material));
-        const auto back = std::make_shared<FlipNormals>
-        (FlipNormals(std::make_shared<Rectangle_XY>(Rectangle_XY(p0_x, p1_x, p0_y, p1_y, p0_z, material))));
-        const auto top = std::make_shared<Rectangle_XZ>
-                (Rectangle_XZ(p0_x, p1_x, p0_z, p1_z, p1_y, material));
-        const auto bottom = std::make_shared<FlipNormals>
-                (FlipNormals(std::make_shared<Rectangle_XZ>(Rectangle_XZ(p0_x, p1_x, p0_z, p1_z, p0_y, material))));
-        const auto right = std::make_shared<Rectangle_YZ>
-        (Rectangle_YZ(p0_y, p1_y, p0_z, p1_z, p1_x, material));
-        const auto left = std::make_shared<FlipNormals>
-        (FlipNormals(std::make_shared<Rectangle_YZ>(Rectangle_YZ(p0_y, p1_y, p0_z, p1_z, p0_x, material))));
-
-        hittable_list_ = std::make_unique<HittableWorld>(HittableWorld(/*size=*/6));
-        hittable_list_->add(front);
-        hittable_list_->add(back);
-        hittable_list_->add(top);
-        hittable_list_->add(bottom);
-        hittable_list_->add(right);
-        hittable_list_->add(left);
-
-        block_pointer_ = hittable_list_.get();
-    }
+    Block(const BoundVec3& p0, const BoundVec3& p1, std::shared_ptr<const Material> material) :
+            Block(p0, p1, {material, material, material, material, material, material}) {}
+
+    // 'materials' is indexed by BLOCK_FACE.
+    Block(const BoundVec3& p0, const BoundVec3& p1, const std::array<std::shared_ptr<const Material>, 6>& materials) :
+            p_min_(get_min(p0.x(), p1.x()), get_min(p0.y(), p1.y()), get_min(p0.z(), p1.z())),
+            p_max_(get_max(p0.x(), p1.x()), get_max(p0.y(), p1.y()), get_max(p0.z(), p1.z())),
+            materials_{materials} {}
+
+    // The ray hits the side it enters through, or if it starts inside the block, the side it leaves through.
     virtual bool hit(const Ray& ray, value_type t0, value_type t1, HitRecord& record) const override {
-        return block_pointer_->hit(ray, t0, t1, record);
+        value_type t;
+        int face;
+        if (!intersect(ray, t0, t1, t, face)) return false;
+
+        const int axis = face / 2;
+        const BoundVec3 p = ray.point_at_parameter(t);
+        // The in-plane axes, in the order Rectangle_YZ, Rectangle_XZ and Rectangle_XY use for u and v.
+        const int u_axis = axis == 0 ? 1 : 0;
+        const int v_axis = axis == 2 ? 1 : 2;
+        FreeVec3 normal(0, 0, 0);
+        normal[axis] = face % 2 == 0 ? -1 : 1;
+
+        record.u = (p[u_axis] - p_min_[u_axis]) / (p_max_[u_axis] - p_min_[u_axis]);
+        record.v = (p[v_axis] - p_min_[v_axis]) / (p_max_[v_axis] - p_min_[v_axis]);
+        record.hit_point = t;
+        record.point_at_parameter = p;
+        record.normal = normal;
+        record.material = materials_[face];
+        return true;
+    }
+
+    virtual bool occluded(const Ray& ray, value_type t0, value_type t1) const override {
+        value_type t;
+        int face;
+        return intersect(ray, t0, t1, t, face);
     }
 
     virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
@@ -54,9 +66,50 @@ public:
         return true;
     }
 private:
+    // Finds where the ray crosses the surface of the block within [t0, t1], producing the distance in 't'
+    // and the BLOCK_FACE crossed in 'face'. The ray is inside the slab of each axis between the distances
+    // it crosses that axis' two sides; it is inside the block where all three intervals overlap.
+    bool intersect(const Ray& ray, value_type t0, value_type t1, value_type& t, int& face) const {
+        value_type t_enter = -std::numeric_limits<value_type>::max();
+        value_type t_exit = std::numeric_limits<value_type>::max();
+        int enter_face = 0;
+        int exit_face = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+            const value_type inverse_direction = 1.0 / ray.direction().to_free()[axis];
+            value_type t_near = (p_min_[axis] - ray.origin()[axis]) * inverse_direction;
+            value_type t_far = (p_max_[axis] - ray.origin()[axis]) * inverse_direction;
+            int near_face = 2 * axis;
+            int far_face = 2 * axis + 1;
+            if (inverse_direction < 0.0) {
+                std::swap(t_near, t_far);
+                std::swap(near_face, far_face);
+            }
+            if (t_near > t_enter) {
+                t_enter = t_near;
+                enter_face = near_face;
+            }
+            if (t_far < t_exit) {
+                t_exit = t_far;
+                exit_face = far_face;
+            }
+        }
+        if (t_enter > t_exit) return false;
+        if (t_enter >= t0 && t_enter <= t1) {
+            t = t_enter;
+            face = enter_face;
+            return true;
+        }
+        if (t_exit >= t0 && t_exit <= t1) {
+            t = t_exit;
+            face = exit_face;
+            return true;
+        }
+        return false;
+    }
+
     BoundVec3 p_min_;
     BoundVec3 p_max_;
-    Hittable* block_pointer_;
-    std::unique_ptr<HittableWorld> hittable_list_;
+    // The material of each side, indexed by BLOCK_FACE.
+    std::array<std::shared_ptr<const Material>, 6> materials_;
 };
 #endif //RAYTRACING_BLOCK_H
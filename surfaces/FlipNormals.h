@@ -15,6 +15,19 @@ public:
         return false;
     }
 
+    virtual int hit_packet(const RayPacket& packet, int active, value_type t_min,
+                           value_type t_max[], HitRecord records[]) const override {
+        const int hits = hittable_pointer_->hit_packet(packet, active, t_min, t_max, records);
+        for (int i = 0; i < packet.size; ++i) {
+            if (hits >> i & 1) records[i].normal = -records[i].normal;
+        }
+        return hits;
+    }
+
+    virtual bool occluded(const Ray& ray, value_type t_min, value_type t_max) const override {
+        return hittable_pointer_->occluded(ray, t_min, t_max);
+    }
+
     virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
         return hittable_pointer_->bounding_box(t0, t1, box);
     }
@@ -2,6 +2,7 @@
 #define RAYTRACING_HITTABLE_H
 #include "../utility/Vec3.h"
 #include "../utility/Ray.h"
+#include "../utility/RayPacket.h"
 #include "AxisAlignedBoundingBox.h"
 
 class Material; // To avoid circularity of dependencies.
@@ -24,6 +25,27 @@ public:
     // first hit.
     [[nodiscard]] virtual bool hit(const Ray& ray, value_type t_min, value_type t_max, HitRecord& record) const = 0;
 
+    // The packet form of hit(). Each ray i of 'packet' in the mask 'active' is tested over [t_min, t_max[i]].
+    // On a hit, t_max[i] is lowered to the hit and records[i] is filled in, so that the arrays carry the
+    // closest hit so far across calls. Returns the mask of rays that hit.
+    // By default each ray is tested on its own; surfaces override this to share work across the packet.
+    [[nodiscard]] virtual int hit_packet(const RayPacket& packet, int active, value_type t_min,
+                                         value_type t_max[], HitRecord records[]) const {
+        int hits = 0;
+        for (int i = 0; i < packet.size; ++i) {
+            if ((active >> i & 1) && hit(packet.rays[i], t_min, t_max[i], records[i])) {
+                t_max[i] = records[i].hit_point;
+                hits |= 1 << i;
+            }
+        }
+        return hits;
+    }
+
+    // Returns true if the ray hits anything within [t_min, t_max]. Unlike hit(), this returns as soon as
+    // any hit is found rather than the closest, and fills in no record. It is meant for visibility tests,
+    // such as shadow rays towards a light, where only whether something is in the way matters.
+    [[nodiscard]] virtual bool occluded(const Ray& ray, value_type t_min, value_type t_max) const = 0;
+
     // If there exists an axis aligned bounding box within the intervals [t0, t1], produces an axis aligned bounding
     // box in 'box' and returns true. Otherwise, returns false.
     [[nodiscard]] virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const = 0;
@@ -18,10 +18,15 @@ public:
     }
 
     // Returns the number of hittables in the current world.
-    size_t size() {
+    size_t size() const {
         return hittables_.size();
     }
 
+    // Returns the hittables in the current world, in the order they were added.
+    const std::vector<std::shared_ptr<const Hittable>>& hittables() const {
+        return hittables_;
+    }
+
     // Clears the hittable world, removing all hittable surfaces.
     // The size of the world will be zero.
     void clear() {
@@ -42,6 +47,25 @@ public:
         return hit_anything;
     }
 
+    // Passes the whole packet to each hittable in turn. Since t_max carries each ray's closest
+    // hit so far, later hittables only report closer hits.
+    int hit_packet(const RayPacket& packet, int active, value_type t_min,
+                   value_type t_max[], HitRecord records[]) const override {
+        int hits = 0;
+        for (int i = 0; i < hittables_.size(); ++i) {
+            hits |= hittables_[i]->hit_packet(packet, active, t_min, t_max, records);
+        }
+        return hits;
+    }
+
+    // Stops at the first hittable in the way.
+    bool occluded(const Ray& ray, value_type t_min, value_type t_max) const override {
+        for (int i = 0; i < hittables_.size(); ++i) {
+            if (hittables_[i]->occluded(ray, t_min, t_max)) return true;
+        }
+        return false;
+    }
+
     bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
         const size_t list_size = hittables_.size();
         if (list_size <= 0) return false;
@@ -32,6 +32,45 @@ public:
         return true;
     }
 
+    virtual bool occluded(const Ray& ray, value_type t0, value_type t1) const override {
+        const value_type t = (k_ - ray.origin().y()) / ray.direction().y();
+        if (t < t0 || t > t1) return false;
+        const value_type x = ray.origin().x() + ray.direction().x() * t;
+        const value_type z = ray.origin().z() + ray.direction().z() * t;
+        return x >= x0_ && x <= x1_ && z >= z0_ && z <= z1_;
+    }
+
+    // The same test as hit(), with the plane distance and the in-plane coordinates computed
+    // for every ray of the packet in one pass before any hit is recorded.
+    virtual int hit_packet(const RayPacket& packet, int active, value_type t_min,
+                           value_type t_max[], HitRecord records[]) const override {
+        value_type t[max_packet_size];
+        value_type x[max_packet_size];
+        value_type z[max_packet_size];
+        int candidates = 0;
+        for (int i = 0; i < packet.size; ++i) {
+            t[i] = (k_ - packet.origin_y[i]) * packet.inverse_direction_y[i];
+            x[i] = packet.origin_x[i] + packet.direction_x[i] * t[i];
+            z[i] = packet.origin_z[i] + packet.direction_z[i] * t[i];
+            const bool inside = t[i] >= t_min && t[i] <= t_max[i] &&
+                                x[i] >= x0_ && x[i] <= x1_ && z[i] >= z0_ && z[i] <= z1_;
+            candidates |= int(inside) << i;
+        }
+        const int hits = candidates & active;
+        for (int i = 0; i < packet.size; ++i) {
+            if (!(hits >> i & 1)) continue;
+            HitRecord& record = records[i];
+            record.u = (x[i] - x0_) / (x1_ - x0_);
+            record.v = (z[i] - z0_) / (z1_ - z0_);
+            record.hit_point = t[i];
+            record.point_at_parameter = packet.rays[i].point_at_parameter(t[i]);
+            record.normal = FreeVec3(0, 1, 0);
+            record.material = material_;
+            t_max[i] = t[i];
+        }
+        return hits;
+    }
+
     virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
         box = AxisAlignedBoundingBox(BoundVec3(x0_, k_ - 0.0001, z0_), BoundVec3(x1_, k_ + 0.0001, z1_));
         return true;
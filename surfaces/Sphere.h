@@ -28,31 +28,77 @@ public:
         if (discriminant <= 0) return false;
         const value_type hit_point_one = (-b - std::sqrt(discriminant)) / a;
         if (hit_point_one > t_min && hit_point_one < t_max) {
-            record.hit_point = hit_point_one;
-            record.point_at_parameter = ray.point_at_parameter(hit_point_one);
-            record.normal = (FreeVec3(record.point_at_parameter) - center_) / radius_;
-            record.material = material_;
-            get_sphere_uv(FreeVec3(record.point_at_parameter - center_) / radius_, record.u, record.v);
+            set_hit_record(ray, hit_point_one, record);
             return true;
         }
         const value_type hit_point_two = (-b + std::sqrt(discriminant)) / a;
         if (hit_point_two > t_min && hit_point_two < t_max) {
-            record.hit_point = hit_point_two;
-            record.point_at_parameter = ray.point_at_parameter(hit_point_two);
-            record.normal = (FreeVec3(record.point_at_parameter) - center_) / radius_;
-            record.material = material_;
-            get_sphere_uv(FreeVec3(record.point_at_parameter - center_) / radius_, record.u, record.v);
+            set_hit_record(ray, hit_point_two, record);
             return true;
         }
         return false;
     }
 
+    // The same test as hit(), with the quadratic's coefficients computed for every ray of
+    // the packet in one pass before any hit is recorded.
+    virtual int hit_packet(const RayPacket& packet, int active, value_type t_min,
+                           value_type t_max[], HitRecord records[]) const override {
+        value_type b[max_packet_size];
+        value_type discriminant[max_packet_size];
+        for (int i = 0; i < packet.size; ++i) {
+            const value_type oc_x = packet.origin_x[i] - center_.x();
+            const value_type oc_y = packet.origin_y[i] - center_.y();
+            const value_type oc_z = packet.origin_z[i] - center_.z();
+            // The directions are unit vectors, so a = 1.
+            b[i] = packet.direction_x[i] * oc_x + packet.direction_y[i] * oc_y + packet.direction_z[i] * oc_z;
+            const value_type c = oc_x * oc_x + oc_y * oc_y + oc_z * oc_z - (radius_ * radius_);
+            discriminant[i] = b[i] * b[i] - c;
+        }
+        int hits = 0;
+        for (int i = 0; i < packet.size; ++i) {
+            if (!(active >> i & 1) || discriminant[i] <= 0) continue;
+            const value_type root = std::sqrt(discriminant[i]);
+            value_type hit_point = -b[i] - root;
+            if (!(hit_point > t_min && hit_point < t_max[i])) {
+                hit_point = -b[i] + root;
+                if (!(hit_point > t_min && hit_point < t_max[i])) continue;
+            }
+            set_hit_record(packet.rays[i], hit_point, records[i]);
+            t_max[i] = hit_point;
+            hits |= 1 << i;
+        }
+        return hits;
+    }
+
+    virtual bool occluded(const Ray& ray, value_type t_min, value_type t_max) const override {
+        const BoundVec3 oc = ray.origin() - center_;
+        const FreeVec3 direction = ray.direction().to_free();
+        const value_type a = direction.dot(direction);
+        const value_type b = direction.dot(oc);
+        const value_type c = oc.dot(oc) - (radius_ * radius_);
+        const value_type discriminant = (b * b) - (a * c);
+        if (discriminant <= 0) return false;
+        const value_type root = std::sqrt(discriminant);
+        const value_type hit_point_one = (-b - root) / a;
+        const value_type hit_point_two = (-b + root) / a;
+        return (hit_point_one > t_min && hit_point_one < t_max) || (hit_point_two > t_min && hit_point_two < t_max);
+    }
+
     virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
         const FreeVec3 radius_vector(radius_, radius_, radius_);
         box = AxisAlignedBoundingBox(BoundVec3(center_ - radius_vector), BoundVec3(center_ + radius_vector));
         return true;
     }
 private:
+    // Fills in 'record' for a hit of 'ray' at 'hit_point'.
+    void set_hit_record(const Ray& ray, value_type hit_point, HitRecord& record) const {
+        record.hit_point = hit_point;
+        record.point_at_parameter = ray.point_at_parameter(hit_point);
+        record.normal = (FreeVec3(record.point_at_parameter) - center_) / radius_;
+        record.material = material_;
+        get_sphere_uv(FreeVec3(record.point_at_parameter - center_) / radius_, record.u, record.v);
+    }
+
     // Used to produce 2-dimensional texture coordinates for a spherical surface.
     void get_sphere_uv(const FreeVec3& p, value_type& u, value_type& v) const {
         const value_type phi = atan2(p.z(), p.x());
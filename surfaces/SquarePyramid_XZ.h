@@ -59,6 +59,10 @@ public:
         return square_pyramid_pointer_->hit(ray, t0, t1, record);
     }
 
+    virtual bool occluded(const Ray& ray, value_type t0, value_type t1) const override {
+        return square_pyramid_pointer_->occluded(ray, t0, t1);
+    }
+
     virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
         box = AxisAlignedBoundingBox(base_, base_ + FreeVec3(height_, height_, height_));
         return true;
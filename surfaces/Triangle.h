@@ -21,8 +21,55 @@ public:
     // If these all return true, it is a hit within the triangle. This is referred
     // to as the "inside-outside" technique, and can be used for any convex polygon.
     virtual bool hit(const Ray& ray, value_type t0, value_type t1, HitRecord& record) const override {
+        return hit(ray, (b_ - a_).cross((c_ - a_)), t0, t1, record);
+    }
+
+    // The same test as hit(), with the triangle's normal computed once for the whole packet.
+    virtual int hit_packet(const RayPacket& packet, int active, value_type t_min,
+                           value_type t_max[], HitRecord records[]) const override {
+        const FreeVec3 normal = (b_ - a_).cross((c_ - a_));
+        int hits = 0;
+        for (int i = 0; i < packet.size; ++i) {
+            if ((active >> i & 1) && hit(packet.rays[i], normal, t_min, t_max[i], records[i])) {
+                t_max[i] = records[i].hit_point;
+                hits |= 1 << i;
+            }
+        }
+        return hits;
+    }
+
+    // The inside-outside test of hit(), without the texture coordinates.
+    virtual bool occluded(const Ray& ray, value_type t0, value_type t1) const override {
         const FreeVec3 normal = (b_ - a_).cross((c_ - a_));
+        const value_type t = ((a_ - ray.origin()).dot(normal)) / (ray.direction().to_free().dot(normal));
+        if (t < t0 || t > t1) return false;
+        const BoundVec3 p = ray.point_at_parameter(t);
+        return normal.dot((b_ - a_).cross(p - a_)) >= 0 &&
+               normal.dot((c_ - b_).cross(p - b_)) >= 0 &&
+               normal.dot((a_ - c_).cross(p - c_)) >= 0;
+    }
+
+    // Determined by finding minimum & maximum x-, y- and z-coordinates
+    // from the three vertices of the triangle.
+    virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
+        const value_type max_x = get_max(a_.x(), get_max(b_.x(), c_.x()));
+        const value_type max_y = get_max(a_.y(), get_max(b_.y(), c_.y()));
+        const value_type max_z = get_max(a_.z(), get_max(b_.z(), c_.z()));
+
+        const value_type min_x = get_min(a_.x(), get_min(b_.x(), c_.x()));
+        const value_type min_y = get_min(a_.y(), get_min(b_.y(), c_.y()));
+        const value_type min_z = get_min(a_.z(), get_min(b_.z(), c_.z()));
 
+        // Like the axis aligned rectangles, pad the box so a triangle lying in an axis plane
+        // still produces a box with nonzero thickness.
+        box = AxisAlignedBoundingBox(BoundVec3(min_x - 0.0001, min_y - 0.0001, min_z - 0.0001),
+                                     BoundVec3(max_x + 0.0001, max_y + 0.0001, max_z + 0.0001));
+        return true;
+    }
+
+private:
+    // The test of hit(), given the (unnormalized) normal of the triangle's plane.
+    bool hit(const Ray& ray, const FreeVec3& normal, value_type t0, value_type t1, HitRecord& record) const {
         // Ray: p = origin + t * direction.
         // Plane: (p - a).dot(normal) = 0.
         // Substitute p, and we get: (origin + t * direction - a).dot(normal) = 0.
@@ -63,22 +110,6 @@ public:
         return true;
     }
 
-    // Determined by finding minimum & maximum x-, y- and z-coordinates
-    // from the three vertices of the triangle.
-    virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
-        const value_type max_x = get_max(a_.x(), get_max(b_.x(), c_.x()));
-        const value_type max_y = get_max(a_.y(), get_max(b_.y(), c_.y()));
-        const value_type max_z = get_max(a_.z(), get_max(b_.z(), c_.z()));
-
-        const value_type min_x = get_min(a_.x(), get_min(b_.x(), c_.x()));
-        const value_type min_y = get_min(a_.y(), get_min(b_.y(), c_.y()));
-        const value_type min_z = get_min(a_.z(), get_min(b_.z(), c_.z()));
-
-        box = AxisAlignedBoundingBox(BoundVec3(min_x, min_y, min_z), BoundVec3(max_x, max_y, max_z));
-        return false;
-    }
-
-private:
     // The associated material of the triangular surface.
     std::shared_ptr<const Material> material_;
     // The vertices of the triangle.
@@ -0,0 +1,173 @@
+#ifndef RAYTRACING_TRIANGLEMESH_H
+#define RAYTRACING_TRIANGLEMESH_H
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "Hittable.h"
+#include "AxisAlignedBoundingBox.h"
+#include "acceleration/LinearBoundingVolumeHierarchy.h"
+
+// Encapsulates an indexed triangle mesh. Vertices are stored once in flat arrays and shared
+// between the triangles that use them; each triangle is three indices into those arrays.
+// Rays are intersected through a bounding volume hierarchy over the triangles, so a mesh is
+// a single hittable no matter how many triangles it holds. All triangles share one material.
+class TriangleMesh : public Hittable {
+public:
+    // 'indices' holds three vertex indices per triangle.
+    // 'normals' is either empty, or holds one shading normal per vertex.
+    // 'uvs' is either empty, or holds one (u, v) texture coordinate pair per vertex.
+    // If no normals are given, the geometric normal is used. If no texture coordinates are
+    // given, u and v are the barycentric coordinates of the hit within its triangle.
+    TriangleMesh(std::vector<BoundVec3> positions, std::vector<int> indices,
+                 std::shared_ptr<const Material> material,
+                 std::vector<FreeVec3> normals = {}, std::vector<value_type> uvs = {}) :
+            positions_{std::move(positions)}, normals_{std::move(normals)}, uvs_{std::move(uvs)},
+            indices_{std::move(indices)}, material_{material} {
+        if (indices_.size() % 3 != 0) {
+            throw std::invalid_argument("TriangleMesh indices must hold three vertices per triangle.");
+        }
+        if (!normals_.empty() && normals_.size() != positions_.size()) {
+            throw std::invalid_argument("TriangleMesh must have either no normals or one normal per vertex.");
+        }
+        if (!uvs_.empty() && uvs_.size() != 2 * positions_.size()) {
+            throw std::invalid_argument("TriangleMesh must have either no uvs or one (u, v) pair per vertex.");
+        }
+        for (const int index : indices_) {
+            if (index < 0 || index >= positions_.size()) {
+                throw std::invalid_argument("TriangleMesh index refers to a vertex that does not exist.");
+            }
+        }
+        build_hierarchy();
+    }
+
+    // Returns the number of triangles in the mesh.
+    size_t size() const { return indices_.size() / 3; }
+
+    virtual bool hit(const Ray& ray, value_type t_min, value_type t_max, HitRecord& record) const override {
+        const InverseRay inverse_ray(ray);
+        int closest_triangle = -1;
+        value_type closest_b1 = 0.0;
+        value_type closest_b2 = 0.0;
+        tree_.traverse(inverse_ray, t_min, t_max, [&](int triangle, value_type t_min, value_type& t_max) {
+            value_type t, b1, b2;
+            if (!intersect(ray, triangle, t_min, t_max, t, b1, b2)) return false;
+            t_max = t;
+            closest_triangle = triangle;
+            closest_b1 = b1;
+            closest_b2 = b2;
+            return true;
+        });
+        if (closest_triangle < 0) return false;
+
+        // Only the closest triangle needs its normal and texture coordinates.
+        const int i0 = indices_[3 * closest_triangle];
+        const int i1 = indices_[3 * closest_triangle + 1];
+        const int i2 = indices_[3 * closest_triangle + 2];
+        const value_type b0 = 1.0 - closest_b1 - closest_b2;
+        record.hit_point = t_max;
+        record.point_at_parameter = ray.point_at_parameter(t_max);
+        if (normals_.empty()) {
+            const BoundVec3& p0 = positions_[i0];
+            record.normal = UnitVec3((positions_[i1] - p0).cross(positions_[i2] - p0)).to_free();
+        } else {
+            record.normal = UnitVec3(normals_[i0] * b0 + normals_[i1] * closest_b1 + normals_[i2] * closest_b2)
+                    .to_free();
+        }
+        if (uvs_.empty()) {
+            record.u = closest_b1;
+            record.v = closest_b2;
+        } else {
+            record.u = uvs_[2 * i0] * b0 + uvs_[2 * i1] * closest_b1 + uvs_[2 * i2] * closest_b2;
+            record.v = uvs_[2 * i0 + 1] * b0 + uvs_[2 * i1 + 1] * closest_b1 + uvs_[2 * i2 + 1] * closest_b2;
+        }
+        record.material = material_;
+        return true;
+    }
+
+    virtual bool occluded(const Ray& ray, value_type t_min, value_type t_max) const override {
+        const InverseRay inverse_ray(ray);
+        return tree_.traverse_any(inverse_ray, t_min, t_max, [&](int triangle, value_type t_min, value_type t_max) {
+            value_type t, b1, b2;
+            return intersect(ray, triangle, t_min, t_max, t, b1, b2);
+        });
+    }
+
+    virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
+        if (tree_.empty()) return false;
+        box = tree_.nodes().front().box;
+        return true;
+    }
+
+private:
+    // Builds the hierarchy over the triangles, then reorders the indices into tree order so that
+    // the triangles of each leaf are adjacent in memory.
+    void build_hierarchy() {
+        std::vector<BuildPrimitive> primitives;
+        primitives.reserve(size());
+        for (int triangle = 0; triangle < size(); ++triangle) {
+            const BoundVec3& a = positions_[indices_[3 * triangle]];
+            const BoundVec3& b = positions_[indices_[3 * triangle + 1]];
+            const BoundVec3& c = positions_[indices_[3 * triangle + 2]];
+            // Padded like Triangle::bounding_box, so that triangles in an axis plane have some thickness.
+            const AxisAlignedBoundingBox box(
+                    BoundVec3(get_min(a.x(), get_min(b.x(), c.x())) - 0.0001,
+                              get_min(a.y(), get_min(b.y(), c.y())) - 0.0001,
+                              get_min(a.z(), get_min(b.z(), c.z())) - 0.0001),
+                    BoundVec3(get_max(a.x(), get_max(b.x(), c.x())) + 0.0001,
+                              get_max(a.y(), get_max(b.y(), c.y())) + 0.0001,
+                              get_max(a.z(), get_max(b.z(), c.z())) + 0.0001));
+            primitives.push_back(BuildPrimitive{box, box.centroid(), triangle});
+        }
+        tree_ = LinearBVHTree(std::move(primitives));
+
+        std::vector<int> ordered_indices;
+        ordered_indices.reserve(indices_.size());
+        for (const int triangle : tree_.ordered_indices()) {
+            ordered_indices.push_back(indices_[3 * triangle]);
+            ordered_indices.push_back(indices_[3 * triangle + 1]);
+            ordered_indices.push_back(indices_[3 * triangle + 2]);
+        }
+        indices_ = std::move(ordered_indices);
+    }
+
+    // The Moller-Trumbore ray-triangle intersection. Solves
+    //      origin + t * direction = (1 - b1 - b2) * p0 + b1 * p1 + b2 * p2
+    // for t and the barycentric coordinates b1, b2 using Cramer's rule. Both sides of the
+    // triangle are hit, as with Triangle.
+    bool intersect(const Ray& ray, int triangle, value_type t_min, value_type t_max,
+                   value_type& t, value_type& b1, value_type& b2) const {
+        const BoundVec3& p0 = positions_[indices_[3 * triangle]];
+        const BoundVec3& p1 = positions_[indices_[3 * triangle + 1]];
+        const BoundVec3& p2 = positions_[indices_[3 * triangle + 2]];
+        const FreeVec3 edge1 = p1 - p0;
+        const FreeVec3 edge2 = p2 - p0;
+        const FreeVec3 direction = ray.direction().to_free();
+        const FreeVec3 p = direction.cross(edge2);
+        const value_type determinant = edge1.dot(p);
+        if (std::fabs(determinant) < 1e-12) return false; // The ray is parallel to the triangle.
+        const value_type inverse_determinant = 1.0 / determinant;
+        const FreeVec3 s = ray.origin() - p0;
+        b1 = s.dot(p) * inverse_determinant;
+        if (b1 < 0.0 || b1 > 1.0) return false;
+        const FreeVec3 q = s.cross(edge1);
+        b2 = direction.dot(q) * inverse_determinant;
+        if (b2 < 0.0 || b1 + b2 > 1.0) return false;
+        t = edge2.dot(q) * inverse_determinant;
+        return t > t_min && t < t_max;
+    }
+
+    // The position of each vertex.
+    std::vector<BoundVec3> positions_;
+    // The shading normal of each vertex, if any.
+    std::vector<FreeVec3> normals_;
+    // The (u, v) texture coordinates of each vertex, if any.
+    std::vector<value_type> uvs_;
+    // Three vertex indices per triangle, in the order of the hierarchy's leaves.
+    std::vector<int> indices_;
+    // The associated material of the mesh.
+    std::shared_ptr<const Material> material_;
+    // The hierarchy over the triangles.
+    LinearBVHTree tree_;
+};
+
+#endif //RAYTRACING_TRIANGLEMESH_H
@@ -0,0 +1,124 @@
+#ifndef RAYTRACING_BOUNDINGVOLUMEHIERARCHY_H
+#define RAYTRACING_BOUNDINGVOLUMEHIERARCHY_H
+#include "../Hittable.h"
+#include "../HittableWorld.h"
+#include "SurfaceAreaHeuristic.h"
+#include "TraversalStatistics.h"
+#include <memory>
+#include <vector>
+
+// A binary tree of bounding boxes over a collection of hittables. A ray only visits the
+// children whose boxes it passes through, so intersection cost grows logarithmically
+// with the number of hittables rather than linearly as in HittableWorld.
+// Splits are chosen using the surface area heuristic. Hittables without a bounding box
+// (see Hittable::bounding_box) cannot be placed in the tree, and are tested on every ray.
+class BoundingVolumeHierarchy : public Hittable {
+public:
+    // Builds the hierarchy over the hittables of 'world'. The boxes are taken over
+    // the shutter interval [t0, t1].
+    BoundingVolumeHierarchy(const HittableWorld& world, value_type t0, value_type t1)
+            : BoundingVolumeHierarchy(world.hittables(), t0, t1) {}
+
+    BoundingVolumeHierarchy(const std::vector<std::shared_ptr<const Hittable>>& hittables,
+                            value_type t0, value_type t1) {
+        std::vector<BuildPrimitive> primitives;
+        primitives.reserve(hittables.size());
+        for (int i = 0; i < hittables.size(); ++i) {
+            AxisAlignedBoundingBox box;
+            if (hittables[i]->bounding_box(t0, t1, box)) {
+                primitives.push_back(BuildPrimitive{box, box.centroid(), i});
+            } else {
+                unbounded_.add(hittables[i]);
+            }
+        }
+        if (!primitives.empty()) {
+            box_ = bounds_of(primitives, 0, primitives.size());
+            root_ = build(hittables, primitives, 0, primitives.size());
+        }
+    }
+
+    bool hit(const Ray& ray, value_type t_min, value_type t_max, HitRecord& record) const override {
+        bool hit_anything = false;
+        if (root_ && root_->hit(ray, t_min, t_max, record)) {
+            hit_anything = true;
+            t_max = record.hit_point;
+        }
+        if (unbounded_.hit(ray, t_min, t_max, record)) {
+            hit_anything = true;
+        }
+        return hit_anything;
+    }
+
+    bool occluded(const Ray& ray, value_type t_min, value_type t_max) const override {
+        return (root_ && root_->occluded(ray, t_min, t_max)) || unbounded_.occluded(ray, t_min, t_max);
+    }
+
+    bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
+        if (!root_ || unbounded_.size() > 0) return false;
+        box = box_;
+        return true;
+    }
+
+private:
+    // The maximum number of hittables a leaf may hold.
+    static constexpr int max_leaf_size_ = 4;
+
+    // An interior node of the tree. Its children are either further nodes, or the leaves themselves.
+    class Node : public Hittable {
+    public:
+        Node(std::shared_ptr<const Hittable> left, std::shared_ptr<const Hittable> right,
+             const AxisAlignedBoundingBox& box) : left_{left}, right_{right}, box_{box} {}
+
+        bool hit(const Ray& ray, value_type t_min, value_type t_max, HitRecord& record) const override {
+            if constexpr (collect_traversal_statistics) ++traversal_statistics().nodes_visited;
+            if (!box_.hit(ray, t_min, t_max)) return false;
+            const bool hit_left = left_->hit(ray, t_min, t_max, record);
+            const bool hit_right = right_->hit(ray, t_min, hit_left ? record.hit_point : t_max, record);
+            return hit_left || hit_right;
+        }
+
+        bool occluded(const Ray& ray, value_type t_min, value_type t_max) const override {
+            if constexpr (collect_traversal_statistics) ++traversal_statistics().nodes_visited;
+            if (!box_.hit(ray, t_min, t_max)) return false;
+            return left_->occluded(ray, t_min, t_max) || right_->occluded(ray, t_min, t_max);
+        }
+
+        bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
+            box = box_;
+            return true;
+        }
+
+    private:
+        std::shared_ptr<const Hittable> left_;
+        std::shared_ptr<const Hittable> right_;
+        AxisAlignedBoundingBox box_;
+    };
+
+    // Recursively builds the subtree over primitives [begin, end). A single hittable is its own leaf,
+    // and a small group the heuristic decides not to split is gathered into a HittableWorld.
+    static std::shared_ptr<const Hittable> build(const std::vector<std::shared_ptr<const Hittable>>& hittables,
+                                                 std::vector<BuildPrimitive>& primitives, int begin, int end) {
+        if (end - begin == 1) return hittables[primitives[begin].index];
+        SurfaceAreaSplit split;
+        if (!find_surface_area_split(primitives, begin, end, max_leaf_size_, split)) {
+            auto leaf = std::make_shared<HittableWorld>(HittableWorld(end - begin));
+            for (int i = begin; i < end; ++i) {
+                leaf->add(hittables[primitives[i].index]);
+            }
+            return leaf;
+        }
+        const AxisAlignedBoundingBox box = bounds_of(primitives, begin, end);
+        const auto left = build(hittables, primitives, begin, split.middle);
+        const auto right = build(hittables, primitives, split.middle, end);
+        return std::make_shared<Node>(Node(left, right, box));
+    }
+
+    // The root of the tree, or null if no hittable has a bounding box.
+    std::shared_ptr<const Hittable> root_;
+    // The box surrounding every hittable in the tree.
+    AxisAlignedBoundingBox box_;
+    // The hittables without a bounding box.
+    HittableWorld unbounded_;
+};
+
+#endif //RAYTRACING_BOUNDINGVOLUMEHIERARCHY_H
@@ -0,0 +1,378 @@
+#ifndef RAYTRACING_LINEARBOUNDINGVOLUMEHIERARCHY_H
+#define RAYTRACING_LINEARBOUNDINGVOLUMEHIERARCHY_H
+#include "../Hittable.h"
+#include "../HittableWorld.h"
+#include "MortonCode.h"
+#include "SurfaceAreaHeuristic.h"
+#include "TraversalStatistics.h"
+#include <algorithm>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// A node of a flattened bounding volume hierarchy. Nodes are stored in depth-first order, so the
+// first child of an interior node is always the node directly after it.
+struct LinearBVHNode {
+    AxisAlignedBoundingBox box;
+    // For a leaf, the position of its first primitive. For an interior node, the index of its second child.
+    int32_t offset;
+    // The number of primitives in a leaf, or 0 for an interior node.
+    uint16_t primitive_count;
+    // The axis an interior node was split along.
+    uint8_t axis;
+};
+
+// How a LinearBVHTree chooses its splits.
+enum BVH_BUILD_METHOD {
+    // Surface area heuristic splits, unless there are at least morton_build_threshold primitives.
+    AUTOMATIC,
+    // Splits chosen with find_surface_area_split(). Slower to build, faster to trace.
+    SURFACE_AREA_HEURISTIC,
+    // Splits along the Morton order of the centroids (see find_morton_split()). Builds several times
+    // faster than the surface area heuristic, at the cost of a tree that is slower to trace.
+    MORTON_CODE
+};
+
+// A bounding volume hierarchy over primitives identified only by their boxes, stored as a single
+// contiguous array of nodes. Leaves refer to ranges of ordered_indices(), which lists the
+// primitives in tree order; the owner should store its primitives in that order so that a
+// leaf's primitives are also adjacent in memory.
+class LinearBVHTree {
+public:
+    // The maximum number of primitives a leaf may hold.
+    static constexpr int max_leaf_size = 4;
+    // The number of primitives from which AUTOMATIC switches to MORTON_CODE.
+    static constexpr int morton_build_threshold = 1 << 21;
+    // The smallest subtree whose two halves are built in parallel.
+    static constexpr int parallel_build_threshold = 1 << 12;
+    // The depth below which ranges are split at their median rather than by the surface area heuristic,
+    // which may peel off one primitive at a time. Median splits halve a range, so no tree is deeper than
+    // max_depth, which bounds the traversal stacks.
+    static constexpr int max_surface_area_depth = 96;
+    static constexpr int max_depth = 128;
+
+    LinearBVHTree() {}
+
+    // Builds the tree. The index of each BuildPrimitive is the identifier reported back through
+    // ordered_indices(). Near the root, the two subtrees of each node are built at the same time,
+    // on as many threads as the hardware supports.
+    explicit LinearBVHTree(std::vector<BuildPrimitive> primitives, BVH_BUILD_METHOD method = AUTOMATIC) {
+        if (primitives.empty()) return;
+        if (method == AUTOMATIC) {
+            method = primitives.size() >= morton_build_threshold ? MORTON_CODE : SURFACE_AREA_HEURISTIC;
+        }
+        std::vector<uint32_t> codes;
+        if (method == MORTON_CODE) codes = sort_by_morton_code(primitives);
+
+        // Enough levels of parallel subtrees for every thread to have a few of them.
+        int parallel_depth = 2;
+        for (unsigned threads = std::thread::hardware_concurrency(); threads > 1; threads /= 2) {
+            ++parallel_depth;
+        }
+        nodes_.reserve(2 * primitives.size());
+        ordered_indices_.reserve(primitives.size());
+        build(primitives, codes.empty() ? nullptr : codes.data(), 0, primitives.size(), 0, parallel_depth,
+              nodes_, ordered_indices_);
+        nodes_.shrink_to_fit();
+    }
+
+    bool empty() const { return nodes_.empty(); }
+
+    // The expected cost of tracing a ray that hits the root's box through the tree, under the surface area
+    // heuristic: the cost of each node, weighted by the probability that the ray also hits the node's box.
+    // Lower is better; this measures the quality of a tree independently of the rays traced through it.
+    value_type surface_area_heuristic_cost() const {
+        if (nodes_.empty()) return 0.0;
+        const value_type root_area = nodes_.front().box.surface_area();
+        value_type cost = 0.0;
+        for (const LinearBVHNode& node : nodes_) {
+            const value_type weight = root_area > 0.0 ? node.box.surface_area() / root_area : 1.0;
+            cost += weight * (node.primitive_count > 0 ? node.primitive_count * sah_intersection_cost
+                                                       : sah_traversal_cost);
+        }
+        return cost;
+    }
+
+    const std::vector<LinearBVHNode>& nodes() const { return nodes_; }
+
+    const std::vector<int>& ordered_indices() const { return ordered_indices_; }
+
+    // Walks the tree with an explicit stack, visiting the nearer child of each interior node first so
+    // that closer hits shrink t_max before the farther subtree is tested.
+    // 'intersect' is called as intersect(position, t_min, t_max) for each primitive in a leaf the ray
+    // reaches, where position indexes ordered_indices(). It returns true on a hit closer than t_max,
+    // and lowers t_max to that hit.
+    template <typename Intersector>
+    bool traverse(const InverseRay& ray, value_type t_min, value_type& t_max, Intersector&& intersect) const {
+        if (nodes_.empty()) return false;
+        bool hit_anything = false;
+        int stack[max_depth];
+        int stack_size = 0;
+        int current = 0;
+        while (true) {
+            const LinearBVHNode& node = nodes_[current];
+            if constexpr (collect_traversal_statistics) ++traversal_statistics().nodes_visited;
+            if (node.box.hit(ray, t_min, t_max)) {
+                if (node.primitive_count > 0) {
+                    for (int i = node.offset; i < node.offset + node.primitive_count; ++i) {
+                        if constexpr (collect_traversal_statistics) ++traversal_statistics().primitives_tested;
+                        if (intersect(i, t_min, t_max)) hit_anything = true;
+                    }
+                } else if (ray.is_negative[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                    continue;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+            if (stack_size == 0) break;
+            current = stack[--stack_size];
+        }
+        return hit_anything;
+    }
+
+    // The any-hit form of traverse(), for occlusion queries. Children are visited in the same order, but
+    // the walk stops at the first primitive for which 'occluded(position, t_min, t_max)' returns true.
+    template <typename OcclusionTest>
+    bool traverse_any(const InverseRay& ray, value_type t_min, value_type t_max, OcclusionTest&& occluded) const {
+        if (nodes_.empty()) return false;
+        int stack[max_depth];
+        int stack_size = 0;
+        int current = 0;
+        while (true) {
+            const LinearBVHNode& node = nodes_[current];
+            if constexpr (collect_traversal_statistics) ++traversal_statistics().nodes_visited;
+            if (node.box.hit(ray, t_min, t_max)) {
+                if (node.primitive_count > 0) {
+                    for (int i = node.offset; i < node.offset + node.primitive_count; ++i) {
+                        if constexpr (collect_traversal_statistics) ++traversal_statistics().primitives_tested;
+                        if (occluded(i, t_min, t_max)) return true;
+                    }
+                } else if (ray.is_negative[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                    continue;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+            if (stack_size == 0) break;
+            current = stack[--stack_size];
+        }
+        return false;
+    }
+
+    // The packet form of traverse(). Each node is tested against the rays still active at it, and
+    // only that subset continues to its children; a subtree is skipped once no ray reaches it.
+    // Children are ordered by the direction of the first active ray, as the rays are assumed coherent.
+    // 'intersect' is called as intersect(position, mask, t_min, t_max) for each primitive in a leaf,
+    // with the same contract as Hittable::hit_packet, and returns the mask of rays that hit.
+    template <typename PacketIntersector>
+    int traverse_packet(const RayPacket& packet, int active, value_type t_min, value_type t_max[],
+                        PacketIntersector&& intersect) const {
+        if (nodes_.empty() || active == 0) return 0;
+        int hits = 0;
+        int stack[max_depth];
+        int stack_masks[max_depth];
+        int stack_size = 0;
+        int current = 0;
+        int mask = active;
+        while (true) {
+            const LinearBVHNode& node = nodes_[current];
+            if constexpr (collect_traversal_statistics) ++traversal_statistics().nodes_visited;
+            mask = node.box.hit(packet, mask, t_min, t_max);
+            if (mask != 0) {
+                if (node.primitive_count > 0) {
+                    for (int i = node.offset; i < node.offset + node.primitive_count; ++i) {
+                        if constexpr (collect_traversal_statistics) ++traversal_statistics().primitives_tested;
+                        hits |= intersect(i, mask, t_min, t_max);
+                    }
+                } else {
+                    const int first = __builtin_ctz(mask);
+                    const value_type direction = node.axis == 0 ? packet.direction_x[first]
+                            : node.axis == 1 ? packet.direction_y[first] : packet.direction_z[first];
+                    const int near = direction < 0.0 ? node.offset : current + 1;
+                    const int far = direction < 0.0 ? current + 1 : node.offset;
+                    stack[stack_size] = far;
+                    stack_masks[stack_size++] = mask;
+                    current = near;
+                    continue;
+                }
+            }
+            if (stack_size == 0) break;
+            current = stack[--stack_size];
+            mask = stack_masks[stack_size];
+        }
+        return hits;
+    }
+
+private:
+    // Appends the subtree over primitives [begin, end) to 'nodes' and 'ordered_indices' in depth-first order,
+    // and returns its index. Splits follow 'codes' if given (see sort_by_morton_code()), and otherwise the
+    // surface area heuristic down to max_surface_area_depth, with 'depth' the depth of the subtree's root.
+    // While 'parallel_depth' is positive and the range is large enough, the second subtree is built on
+    // another thread into its own arrays, then appended after the first.
+    static int build(std::vector<BuildPrimitive>& primitives, const uint32_t* codes, int begin, int end, int depth,
+                     int parallel_depth, std::vector<LinearBVHNode>& nodes, std::vector<int>& ordered_indices) {
+        const int index = nodes.size();
+        nodes.push_back(LinearBVHNode{bounds_of(primitives, begin, end), 0, 0, 0});
+        SurfaceAreaSplit split;
+        bool is_leaf;
+        if (codes) {
+            is_leaf = end - begin <= max_leaf_size;
+            if (!is_leaf) find_morton_split(codes, begin, end, split);
+        } else if (depth >= max_surface_area_depth) {
+            is_leaf = end - begin <= max_leaf_size;
+            if (!is_leaf) find_median_split(primitives, begin, end, split);
+        } else {
+            is_leaf = !find_surface_area_split(primitives, begin, end, max_leaf_size, split);
+        }
+        if (is_leaf) {
+            nodes[index].offset = ordered_indices.size();
+            nodes[index].primitive_count = end - begin;
+            for (int i = begin; i < end; ++i) {
+                ordered_indices.push_back(primitives[i].index);
+            }
+            return index;
+        }
+        nodes[index].axis = split.axis;
+
+        if (parallel_depth <= 0 || end - begin < parallel_build_threshold) {
+            build(primitives, codes, begin, split.middle, depth + 1, 0, nodes, ordered_indices);
+            nodes[index].offset = build(primitives, codes, split.middle, end, depth + 1, 0, nodes, ordered_indices);
+            return index;
+        }
+
+        // The two subtrees own disjoint ranges of 'primitives', so they can be built at the same time.
+        std::vector<LinearBVHNode> second_nodes;
+        std::vector<int> second_indices;
+        std::future<int> second = std::async(std::launch::async, [&]() {
+            second_nodes.reserve(2 * (end - split.middle));
+            second_indices.reserve(end - split.middle);
+            return build(primitives, codes, split.middle, end, depth + 1, parallel_depth - 1, second_nodes,
+                         second_indices);
+        });
+        build(primitives, codes, begin, split.middle, depth + 1, parallel_depth - 1, nodes, ordered_indices);
+        second.get();
+
+        // The second subtree's node and primitive positions are relative to its own arrays.
+        const int node_base = nodes.size();
+        const int primitive_base = ordered_indices.size();
+        for (LinearBVHNode node : second_nodes) {
+            node.offset += node.primitive_count > 0 ? primitive_base : node_base;
+            nodes.push_back(node);
+        }
+        ordered_indices.insert(ordered_indices.end(), second_indices.begin(), second_indices.end());
+        nodes[index].offset = node_base;
+        return index;
+    }
+
+    // Splits primitives [begin, end) in half at the median centroid along the axis the centroids spread most.
+    static void find_median_split(std::vector<BuildPrimitive>& primitives, int begin, int end,
+                                  SurfaceAreaSplit& split) {
+        AxisAlignedBoundingBox centroid_box(primitives[begin].centroid, primitives[begin].centroid);
+        for (int i = begin + 1; i < end; ++i) {
+            centroid_box = AxisAlignedBoundingBox::surrounding_box(
+                    centroid_box, AxisAlignedBoundingBox(primitives[i].centroid, primitives[i].centroid));
+        }
+        const FreeVec3 extent = centroid_box.max() - centroid_box.min();
+        const int axis = extent.x() >= extent.y() && extent.x() >= extent.z() ? 0 : extent.y() >= extent.z() ? 1 : 2;
+        split.axis = axis;
+        split.middle = (begin + end) / 2;
+        split.cost = 0.0;
+        std::nth_element(primitives.begin() + begin, primitives.begin() + split.middle, primitives.begin() + end,
+                [axis](const BuildPrimitive& a, const BuildPrimitive& b) {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+    }
+
+    std::vector<LinearBVHNode> nodes_;
+    std::vector<int> ordered_indices_;
+};
+
+// A bounding volume hierarchy over a collection of hittables, stored as a flat array of nodes
+// (see LinearBVHTree) and traversed iteratively. This avoids the pointer chasing and the virtual
+// call per node of BoundingVolumeHierarchy; only the hittables in the leaves are called virtually.
+// Hittables without a bounding box are tested on every ray.
+class LinearBoundingVolumeHierarchy : public Hittable {
+public:
+    // Builds the hierarchy over the hittables of 'world'. The boxes are taken over
+    // the shutter interval [t0, t1].
+    LinearBoundingVolumeHierarchy(const HittableWorld& world, value_type t0, value_type t1)
+            : LinearBoundingVolumeHierarchy(world.hittables(), t0, t1) {}
+
+    LinearBoundingVolumeHierarchy(const std::vector<std::shared_ptr<const Hittable>>& hittables,
+                                  value_type t0, value_type t1) {
+        std::vector<BuildPrimitive> primitives;
+        primitives.reserve(hittables.size());
+        for (int i = 0; i < hittables.size(); ++i) {
+            AxisAlignedBoundingBox box;
+            if (hittables[i]->bounding_box(t0, t1, box)) {
+                primitives.push_back(BuildPrimitive{box, box.centroid(), i});
+            } else {
+                unbounded_.add(hittables[i]);
+            }
+        }
+        tree_ = LinearBVHTree(std::move(primitives));
+        ordered_hittables_.reserve(tree_.ordered_indices().size());
+        for (const int index : tree_.ordered_indices()) {
+            ordered_hittables_.push_back(hittables[index]);
+        }
+    }
+
+    bool hit(const Ray& ray, value_type t_min, value_type t_max, HitRecord& record) const override {
+        const InverseRay inverse_ray(ray);
+        bool hit_anything = tree_.traverse(inverse_ray, t_min, t_max,
+                [&](int position, value_type t_min, value_type& t_max) {
+            if (ordered_hittables_[position]->hit(ray, t_min, t_max, record)) {
+                t_max = record.hit_point;
+                return true;
+            }
+            return false;
+        });
+        if (unbounded_.hit(ray, t_min, t_max, record)) {
+            hit_anything = true;
+        }
+        return hit_anything;
+    }
+
+    int hit_packet(const RayPacket& packet, int active, value_type t_min,
+                   value_type t_max[], HitRecord records[]) const override {
+        int hits = tree_.traverse_packet(packet, active, t_min, t_max,
+                [&](int position, int mask, value_type t_min, value_type t_max[]) {
+            return ordered_hittables_[position]->hit_packet(packet, mask, t_min, t_max, records);
+        });
+        hits |= unbounded_.hit_packet(packet, active, t_min, t_max, records);
+        return hits;
+    }
+
+    bool occluded(const Ray& ray, value_type t_min, value_type t_max) const override {
+        const InverseRay inverse_ray(ray);
+        return tree_.traverse_any(inverse_ray, t_min, t_max,
+                [&](int position, value_type t_min, value_type t_max) {
+            return ordered_hittables_[position]->occluded(ray, t_min, t_max);
+        }) || unbounded_.occluded(ray, t_min, t_max);
+    }
+
+    bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
+        if (tree_.empty() || unbounded_.size() > 0) return false;
+        box = tree_.nodes().front().box;
+        return true;
+    }
+
+private:
+    LinearBVHTree tree_;
+    // The hittables in tree order, so that each leaf refers to a contiguous range.
+    std::vector<std::shared_ptr<const Hittable>> ordered_hittables_;
+    // The hittables without a bounding box.
+    HittableWorld unbounded_;
+};
+
+#endif //RAYTRACING_LINEARBOUNDINGVOLUMEHIERARCHY_H
@@ -0,0 +1,80 @@
+#ifndef RAYTRACING_MORTONCODE_H
+#define RAYTRACING_MORTONCODE_H
+#include "SurfaceAreaHeuristic.h"
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// The number of bits of each coordinate kept in a Morton code.
+constexpr int morton_bits_per_axis = 10;
+
+// Spreads the lower 10 bits of 'value' out so that two zero bits follow each of them.
+inline uint32_t expand_bits(uint32_t value) {
+    value = (value * 0x00010001u) & 0xFF0000FFu;
+    value = (value * 0x00000101u) & 0x0F00F00Fu;
+    value = (value * 0x00000011u) & 0xC30C30C3u;
+    value = (value * 0x00000005u) & 0x49249249u;
+    return value;
+}
+
+// Interleaves the bits of the three coordinates of 'point', each quantized to 10 bits within 'bounds',
+// as ...x1y1z1x0y0z0. Sorting by this code lays points out along a Z-order curve, on which points
+// that are close together in space are mostly close together in order.
+inline uint32_t morton_code(const BoundVec3& point, const AxisAlignedBoundingBox& bounds) {
+    uint32_t code = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        const value_type extent = bounds.max()[axis] - bounds.min()[axis];
+        const value_type unit = extent > 0.0 ? (point[axis] - bounds.min()[axis]) / extent : 0.0;
+        const value_type scaled = unit * (1 << morton_bits_per_axis);
+        const uint32_t quantized = uint32_t(std::clamp(scaled, value_type(0), value_type((1 << morton_bits_per_axis) - 1)));
+        code |= expand_bits(quantized) << (2 - axis);
+    }
+    return code;
+}
+
+// Sorts 'primitives' by the Morton codes of their centroids, and returns the codes in the same order.
+inline std::vector<uint32_t> sort_by_morton_code(std::vector<BuildPrimitive>& primitives) {
+    AxisAlignedBoundingBox centroid_bounds(primitives[0].centroid, primitives[0].centroid);
+    for (const BuildPrimitive& primitive : primitives) {
+        centroid_bounds = AxisAlignedBoundingBox::surrounding_box(
+                centroid_bounds, AxisAlignedBoundingBox(primitive.centroid, primitive.centroid));
+    }
+    std::vector<std::pair<uint32_t, int>> keys(primitives.size());
+    for (int i = 0; i < primitives.size(); ++i) {
+        keys[i] = {morton_code(primitives[i].centroid, centroid_bounds), i};
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<BuildPrimitive> sorted;
+    sorted.reserve(primitives.size());
+    std::vector<uint32_t> codes;
+    codes.reserve(primitives.size());
+    for (const auto& key : keys) {
+        sorted.push_back(primitives[key.second]);
+        codes.push_back(key.first);
+    }
+    primitives = std::move(sorted);
+    return codes;
+}
+
+// Splits primitives [begin, end), sorted by Morton code, where the highest bit that differs within the range
+// changes from 0 to 1. This halves the range's cell of the Z-order curve, along the axis of that bit.
+// Needs no box computations at all, so it is far cheaper than a surface area heuristic split.
+// When every code in the range is equal, splits the range in the middle.
+inline void find_morton_split(const uint32_t codes[], int begin, int end, SurfaceAreaSplit& split) {
+    const uint32_t difference = codes[begin] ^ codes[end - 1];
+    split.cost = 0.0;
+    if (difference == 0) {
+        split.axis = 0;
+        split.middle = (begin + end) / 2;
+        return;
+    }
+    const int bit = 31 - __builtin_clz(difference);
+    // Bits 3k + 2, 3k + 1 and 3k come from x, y and z.
+    split.axis = 2 - bit % 3;
+    split.middle = std::partition_point(codes + begin, codes + end,
+            [bit](uint32_t code) { return (code >> bit & 1) == 0; }) - codes;
+}
+
+#endif //RAYTRACING_MORTONCODE_H
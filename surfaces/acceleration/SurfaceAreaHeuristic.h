@@ -0,0 +1,216 @@
+#ifndef RAYTRACING_SURFACEAREAHEURISTIC_H
+#define RAYTRACING_SURFACEAREAHEURISTIC_H
+#include "../AxisAlignedBoundingBox.h"
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+// The cost of visiting an interior node, relative to intersecting a single surface.
+constexpr value_type sah_traversal_cost = 1.0;
+// The cost of intersecting a single surface.
+constexpr value_type sah_intersection_cost = 1.0;
+
+// A surface as seen by an acceleration structure builder: its bounding box, the centroid
+// of that box, and the index of the surface in the caller's list.
+struct BuildPrimitive {
+    AxisAlignedBoundingBox box;
+    BoundVec3 centroid;
+    int index;
+};
+
+// The result of a surface area heuristic split. Primitives [begin, middle) go to the left
+// child, and [middle, end) go to the right child.
+struct SurfaceAreaSplit {
+    int axis;
+    int middle;
+    value_type cost;
+};
+
+// Produces the box surrounding primitives [begin, end).
+inline AxisAlignedBoundingBox bounds_of(const std::vector<BuildPrimitive>& primitives, int begin, int end) {
+    AxisAlignedBoundingBox box = primitives[begin].box;
+    for (int i = begin + 1; i < end; ++i) {
+        box = AxisAlignedBoundingBox::surrounding_box(box, primitives[i].box);
+    }
+    return box;
+}
+
+// Evaluates every split position along every axis for primitives [begin, end), and picks
+// the one minimizing the expected cost of a ray query:
+//      cost = traversal + (area(L) * count(L) + area(R) * count(R)) / area(parent) * intersection
+// On success the range is sorted along the chosen axis and 'split' describes the partition. Of splits that
+// cost the same, the most even one is chosen, so that e.g. coincident primitives still make a shallow tree.
+// Returns false if the range should instead become a leaf, i.e. it holds at most
+// 'max_leaf_size' primitives and intersecting them all is no more expensive than splitting.
+// This takes O(n log n) time, so it is meant for small ranges (see find_surface_area_split).
+inline bool find_exact_surface_area_split(std::vector<BuildPrimitive>& primitives, int begin, int end,
+                                          int max_leaf_size, SurfaceAreaSplit& split) {
+    const int count = end - begin;
+    if (count <= 1) return false;
+    const value_type parent_area = bounds_of(primitives, begin, end).surface_area();
+    const value_type leaf_cost = count * sah_intersection_cost;
+
+    split.cost = std::numeric_limits<value_type>::max();
+    split.axis = -1;
+    // How far the chosen split is from the middle of the range.
+    int split_imbalance = count;
+    std::vector<value_type> right_areas(count);
+    for (int axis = 0; axis < 3; ++axis) {
+        std::sort(primitives.begin() + begin, primitives.begin() + end,
+                [axis](const BuildPrimitive& a, const BuildPrimitive& b) {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+
+        // Sweep from the right to record the area of every suffix, then sweep from the left.
+        AxisAlignedBoundingBox right_box = primitives[end - 1].box;
+        for (int i = count - 1; i > 0; --i) {
+            right_box = AxisAlignedBoundingBox::surrounding_box(right_box, primitives[begin + i].box);
+            right_areas[i] = right_box.surface_area();
+        }
+        AxisAlignedBoundingBox left_box = primitives[begin].box;
+        for (int i = 1; i < count; ++i) {
+            left_box = AxisAlignedBoundingBox::surrounding_box(left_box, primitives[begin + i - 1].box);
+            // A flat parent (e.g. coplanar rectangles) has no area to weigh against, so
+            // every split is equally likely and only the primitive counts matter.
+            const value_type left_weight = parent_area > 0.0 ? left_box.surface_area() / parent_area : 1.0;
+            const value_type right_weight = parent_area > 0.0 ? right_areas[i] / parent_area : 1.0;
+            const value_type cost = sah_traversal_cost +
+                    (left_weight * i + right_weight * (count - i)) * sah_intersection_cost;
+            const int imbalance = std::abs(count - 2 * i);
+            if (cost < split.cost || (cost == split.cost && imbalance < split_imbalance)) {
+                split.cost = cost;
+                split.axis = axis;
+                split.middle = begin + i;
+                split_imbalance = imbalance;
+            }
+        }
+    }
+    if (count <= max_leaf_size && leaf_cost <= split.cost) return false;
+
+    if (split.axis != 2) {
+        const int axis = split.axis;
+        std::sort(primitives.begin() + begin, primitives.begin() + end,
+                [axis](const BuildPrimitive& a, const BuildPrimitive& b) {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+    }
+    return true;
+}
+
+// The number of bins find_binned_surface_area_split() sorts centroids into along each axis.
+constexpr int sah_bin_count = 16;
+// The largest range find_surface_area_split() evaluates every split position for.
+constexpr int sah_exact_split_limit = 64;
+
+// Approximates find_exact_surface_area_split() in linear time. The centroids of primitives [begin, end)
+// are sorted into sah_bin_count equally wide bins along each axis, and only the splits between bins
+// are evaluated, from the bins' counts and boxes. On success the range is partitioned at split.middle.
+// As in the exact sweep, ties go to the most even split.
+inline bool find_binned_surface_area_split(std::vector<BuildPrimitive>& primitives, int begin, int end,
+                                           int max_leaf_size, SurfaceAreaSplit& split) {
+    const int count = end - begin;
+    if (count <= 1) return false;
+    BoundVec3 centroid_min = primitives[begin].centroid;
+    BoundVec3 centroid_max = primitives[begin].centroid;
+    AxisAlignedBoundingBox parent_box = primitives[begin].box;
+    for (int i = begin + 1; i < end; ++i) {
+        const BoundVec3& centroid = primitives[i].centroid;
+        centroid_min = BoundVec3(get_min(centroid_min.x(), centroid.x()), get_min(centroid_min.y(), centroid.y()),
+                                 get_min(centroid_min.z(), centroid.z()));
+        centroid_max = BoundVec3(get_max(centroid_max.x(), centroid.x()), get_max(centroid_max.y(), centroid.y()),
+                                 get_max(centroid_max.z(), centroid.z()));
+        parent_box = AxisAlignedBoundingBox::surrounding_box(parent_box, primitives[i].box);
+    }
+    const value_type parent_area = parent_box.surface_area();
+    const value_type leaf_cost = count * sah_intersection_cost;
+
+    split.cost = std::numeric_limits<value_type>::max();
+    split.axis = -1;
+    int split_bin = 0;
+    value_type split_scale = 0.0;
+    int split_imbalance = count;
+    for (int axis = 0; axis < 3; ++axis) {
+        const value_type extent = centroid_max[axis] - centroid_min[axis];
+        if (!(extent > 0.0)) continue; // Every centroid lies in the same plane.
+        const value_type scale = sah_bin_count / extent;
+        int bin_counts[sah_bin_count] = {};
+        AxisAlignedBoundingBox bin_boxes[sah_bin_count];
+        for (int i = begin; i < end; ++i) {
+            const int bin = std::min(int((primitives[i].centroid[axis] - centroid_min[axis]) * scale),
+                                     sah_bin_count - 1);
+            bin_boxes[bin] = bin_counts[bin] == 0 ? primitives[i].box
+                    : AxisAlignedBoundingBox::surrounding_box(bin_boxes[bin], primitives[i].box);
+            ++bin_counts[bin];
+        }
+
+        // Sweep from the right to record the area and count of every suffix of bins, then sweep from the left.
+        value_type right_areas[sah_bin_count];
+        int right_counts[sah_bin_count];
+        AxisAlignedBoundingBox right_box;
+        int right_count = 0;
+        for (int bin = sah_bin_count - 1; bin > 0; --bin) {
+            if (bin_counts[bin] > 0) {
+                right_box = right_count == 0 ? bin_boxes[bin]
+                        : AxisAlignedBoundingBox::surrounding_box(right_box, bin_boxes[bin]);
+                right_count += bin_counts[bin];
+            }
+            right_areas[bin] = right_count > 0 ? right_box.surface_area() : 0.0;
+            right_counts[bin] = right_count;
+        }
+        AxisAlignedBoundingBox left_box;
+        int left_count = 0;
+        for (int bin = 1; bin < sah_bin_count; ++bin) {
+            if (bin_counts[bin - 1] > 0) {
+                left_box = left_count == 0 ? bin_boxes[bin - 1]
+                        : AxisAlignedBoundingBox::surrounding_box(left_box, bin_boxes[bin - 1]);
+                left_count += bin_counts[bin - 1];
+            }
+            if (left_count == 0 || right_counts[bin] == 0) continue;
+            const value_type left_weight = parent_area > 0.0 ? left_box.surface_area() / parent_area : 1.0;
+            const value_type right_weight = parent_area > 0.0 ? right_areas[bin] / parent_area : 1.0;
+            const value_type cost = sah_traversal_cost +
+                    (left_weight * left_count + right_weight * right_counts[bin]) * sah_intersection_cost;
+            const int imbalance = std::abs(left_count - right_counts[bin]);
+            if (cost < split.cost || (cost == split.cost && imbalance < split_imbalance)) {
+                split.cost = cost;
+                split.axis = axis;
+                split_bin = bin;
+                split_scale = scale;
+                split_imbalance = imbalance;
+            }
+        }
+    }
+    // With every centroid in one point, no split by centroid can tell the primitives apart, so the range is
+    // simply halved, unless it fits in a leaf.
+    if (split.axis < 0) {
+        if (count <= max_leaf_size) return false;
+        split.axis = 0;
+        split.middle = begin + count / 2;
+        split.cost = sah_traversal_cost + count * sah_intersection_cost;
+        return true;
+    }
+    if (count <= max_leaf_size && leaf_cost <= split.cost) return false;
+
+    const int axis = split.axis;
+    const value_type axis_min = centroid_min[axis];
+    const auto middle = std::partition(primitives.begin() + begin, primitives.begin() + end,
+            [&](const BuildPrimitive& primitive) {
+        return std::min(int((primitive.centroid[axis] - axis_min) * split_scale), sah_bin_count - 1) < split_bin;
+    });
+    split.middle = middle - primitives.begin();
+    return true;
+}
+
+// Finds the surface area heuristic split of primitives [begin, end), with the same contract as
+// find_exact_surface_area_split() except that the range is only guaranteed to be partitioned.
+// Large ranges, near the top of a tree, are binned; small ranges are split exactly.
+inline bool find_surface_area_split(std::vector<BuildPrimitive>& primitives, int begin, int end,
+                                    int max_leaf_size, SurfaceAreaSplit& split) {
+    if (end - begin <= sah_exact_split_limit) {
+        return find_exact_surface_area_split(primitives, begin, end, max_leaf_size, split);
+    }
+    return find_binned_surface_area_split(primitives, begin, end, max_leaf_size, split);
+}
+
+#endif //RAYTRACING_SURFACEAREAHEURISTIC_H
@@ -0,0 +1,26 @@
+#ifndef RAYTRACING_TRAVERSALSTATISTICS_H
+#define RAYTRACING_TRAVERSALSTATISTICS_H
+
+// Counting is compiled in only when RAYTRACING_TRAVERSAL_STATISTICS is defined (as the benchmark does),
+// so that rendering does not pay for the counters.
+#ifdef RAYTRACING_TRAVERSAL_STATISTICS
+constexpr bool collect_traversal_statistics = true;
+#else
+constexpr bool collect_traversal_statistics = false;
+#endif
+
+// Counts the work done by acceleration structures.
+struct TraversalStatistics {
+    // The number of tree nodes (or grid cells) whose bounds were tested against a ray.
+    long long nodes_visited = 0;
+    // The number of hittables tested against a ray.
+    long long primitives_tested = 0;
+};
+
+// Returns the statistics of the calling thread.
+inline TraversalStatistics& traversal_statistics() {
+    static thread_local TraversalStatistics statistics;
+    return statistics;
+}
+
+#endif //RAYTRACING_TRAVERSALSTATISTICS_H
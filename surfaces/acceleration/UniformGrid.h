@@ -0,0 +1,244 @@
+#ifndef RAYTRACING_UNIFORMGRID_H
+#define RAYTRACING_UNIFORMGRID_H
+#include "../Hittable.h"
+#include "../HittableWorld.h"
+#include "TraversalStatistics.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// Remembers the hittables a single ray has already been tested against, so that a hittable spanning
+// several cells is tested only once. It is a small direct-mapped table kept on the stack for the
+// duration of one ray, rather than a ray id stored with every hittable, so that any number of rays
+// can walk the same grid at once. Two hittables sharing a slot only cost a repeated test.
+struct GridMailbox {
+    static constexpr int size = 16;
+
+    GridMailbox() { std::fill(entries, entries + size, -1); }
+
+    // Returns true if 'index' was already tested, and otherwise records it.
+    bool test_and_set(int index) {
+        int& entry = entries[index & (size - 1)];
+        if (entry == index) return true;
+        entry = index;
+        return false;
+    }
+
+    int entries[size];
+};
+
+// Divides the box around a collection of hittables into equally sized cells, each listing the hittables
+// whose bounding boxes overlap it. A ray visits only the cells it passes through, front to back, by
+// stepping from cell to cell with a 3D digital differential analyzer, and stops at the first cell that
+// contains a hit. Building takes two passes over the hittables, with no sorting, so it is cheaper than a
+// BoundingVolumeHierarchy; in exchange, it suits evenly distributed scenes (such as the lattice of
+// boxes()) far better than scenes with most of their detail in one place.
+// Hittables without a bounding box are tested on every ray.
+class UniformGrid : public Hittable {
+public:
+    // The number of cells per hittable.
+    static constexpr value_type cell_density = 8.0;
+    // The largest number of cells along any axis.
+    static constexpr int max_resolution = 128;
+
+    // Builds the grid over the hittables of 'world'. The boxes are taken over the shutter interval [t0, t1].
+    UniformGrid(const HittableWorld& world, value_type t0, value_type t1) : UniformGrid(world.hittables(), t0, t1) {}
+
+    UniformGrid(const std::vector<std::shared_ptr<const Hittable>>& hittables, value_type t0, value_type t1) {
+        std::vector<AxisAlignedBoundingBox> boxes;
+        boxes.reserve(hittables.size());
+        for (const auto& hittable : hittables) {
+            AxisAlignedBoundingBox box;
+            if (hittable->bounding_box(t0, t1, box)) {
+                boxes.push_back(box);
+                bounded_.push_back(hittable);
+            } else {
+                unbounded_.add(hittable);
+            }
+        }
+        if (bounded_.empty()) return;
+
+        box_ = boxes[0];
+        for (const AxisAlignedBoundingBox& box : boxes) {
+            box_ = AxisAlignedBoundingBox::surrounding_box(box_, box);
+        }
+        choose_resolution();
+
+        // Count the hittables of each cell, turn the counts into offsets, then fill in the lists.
+        cell_offsets_.assign(cell_count() + 1, 0);
+        for_each_overlapped_cell(boxes, [&](int cell, int) { ++cell_offsets_[cell + 1]; });
+        for (int cell = 0; cell < cell_count(); ++cell) {
+            cell_offsets_[cell + 1] += cell_offsets_[cell];
+        }
+        cell_hittables_.resize(cell_offsets_.back());
+        std::vector<int> filled(cell_offsets_.begin(), cell_offsets_.end() - 1);
+        for_each_overlapped_cell(boxes, [&](int cell, int index) { cell_hittables_[filled[cell]++] = index; });
+    }
+
+    bool hit(const Ray& ray, value_type t_min, value_type t_max, HitRecord& record) const override {
+        bool hit_anything = false;
+        GridMailbox mailbox;
+        walk(ray, t_min, t_max, [&](int cell) {
+            for (int i = cell_offsets_[cell]; i < cell_offsets_[cell + 1]; ++i) {
+                const int index = cell_hittables_[i];
+                if (mailbox.test_and_set(index)) continue;
+                if constexpr (collect_traversal_statistics) ++traversal_statistics().primitives_tested;
+                if (bounded_[index]->hit(ray, t_min, t_max, record)) {
+                    hit_anything = true;
+                    t_max = record.hit_point;
+                }
+            }
+            return false;
+        });
+        if (unbounded_.hit(ray, t_min, t_max, record)) {
+            hit_anything = true;
+        }
+        return hit_anything;
+    }
+
+    bool occluded(const Ray& ray, value_type t_min, value_type t_max) const override {
+        GridMailbox mailbox;
+        const bool occluded = walk(ray, t_min, t_max, [&](int cell) {
+            for (int i = cell_offsets_[cell]; i < cell_offsets_[cell + 1]; ++i) {
+                const int index = cell_hittables_[i];
+                if (mailbox.test_and_set(index)) continue;
+                if constexpr (collect_traversal_statistics) ++traversal_statistics().primitives_tested;
+                if (bounded_[index]->occluded(ray, t_min, t_max)) return true;
+            }
+            return false;
+        });
+        return occluded || unbounded_.occluded(ray, t_min, t_max);
+    }
+
+    bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
+        if (bounded_.empty() || unbounded_.size() > 0) return false;
+        box = box_;
+        return true;
+    }
+
+private:
+    int cell_count() const { return resolution_[0] * resolution_[1] * resolution_[2]; }
+
+    // Gives each axis a number of cells proportional to its extent, so that cells are roughly cubes,
+    // and the grid holds about cell_density cells per hittable. A flat axis is counted as one of the
+    // thinnest cells allowed, so that flat scenes still get a finite number of cells.
+    void choose_resolution() {
+        const FreeVec3 extent = box_.max() - box_.min();
+        const value_type longest = get_max(extent.x(), get_max(extent.y(), extent.z()));
+        const value_type thinnest = longest / max_resolution;
+        const value_type volume = get_max(extent.x(), thinnest) * get_max(extent.y(), thinnest)
+                                * get_max(extent.z(), thinnest);
+        const value_type cells_per_unit = longest > 0.0 ? std::cbrt(cell_density * bounded_.size() / volume) : 0.0;
+        for (int axis = 0; axis < 3; ++axis) {
+            resolution_[axis] = std::clamp(int(extent[axis] * cells_per_unit + 0.5), 1, max_resolution);
+            cell_size_[axis] = extent[axis] / resolution_[axis];
+            inverse_cell_size_[axis] = extent[axis] > 0.0 ? resolution_[axis] / extent[axis] : 0.0;
+        }
+    }
+
+    // Returns the cell along 'axis' containing the coordinate 'position', clamped to the grid.
+    int cell_of(int axis, value_type position) const {
+        const int cell = int((position - box_.min()[axis]) * inverse_cell_size_[axis]);
+        return std::clamp(cell, 0, resolution_[axis] - 1);
+    }
+
+    // Calls visit(cell, index) for every cell overlapped by the box of each hittable.
+    template <typename Visitor>
+    void for_each_overlapped_cell(const std::vector<AxisAlignedBoundingBox>& boxes, Visitor&& visit) const {
+        for (int index = 0; index < int(boxes.size()); ++index) {
+            int first[3], last[3];
+            for (int axis = 0; axis < 3; ++axis) {
+                first[axis] = cell_of(axis, boxes[index].min()[axis]);
+                last[axis] = cell_of(axis, boxes[index].max()[axis]);
+            }
+            for (int z = first[2]; z <= last[2]; ++z) {
+                for (int y = first[1]; y <= last[1]; ++y) {
+                    for (int x = first[0]; x <= last[0]; ++x) {
+                        visit((z * resolution_[1] + y) * resolution_[0] + x, index);
+                    }
+                }
+            }
+        }
+    }
+
+    // Steps through the cells the ray passes within [t_min, t_max], nearest first, calling visit(cell) for
+    // each; visit returns true to stop the walk. t_max is read again after every cell, so a visitor that
+    // lowers it to a hit ends the walk once the ray leaves the cell containing that hit.
+    // Returns true if the walk was stopped by the visitor.
+    template <typename CellVisitor>
+    bool walk(const Ray& ray, value_type t_min, const value_type& t_max, CellVisitor&& visit) const {
+        if (bounded_.empty()) return false;
+        const InverseRay inverse_ray(ray);
+        const BoundVec3 origin = ray.origin();
+        const FreeVec3 direction = ray.direction().to_free();
+
+        // Clip the ray to the grid's box.
+        value_type t_enter = t_min;
+        value_type t_exit = t_max;
+        for (int axis = 0; axis < 3; ++axis) {
+            value_type t0 = (box_.min()[axis] - origin[axis]) * inverse_ray.inverse_direction[axis];
+            value_type t1 = (box_.max()[axis] - origin[axis]) * inverse_ray.inverse_direction[axis];
+            if (inverse_ray.is_negative[axis]) std::swap(t0, t1);
+            t_enter = get_max(t0, t_enter);
+            t_exit = get_min(t1, t_exit);
+        }
+        if (!(t_enter <= t_exit)) return false;
+
+        // Set up the walk from the cell where the ray enters the grid: the distance to the next cell
+        // boundary along each axis, and the distance between boundaries.
+        int cell[3], step[3], end[3];
+        value_type next_crossing[3], crossing_delta[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            const value_type entry = origin[axis] + direction[axis] * t_enter;
+            cell[axis] = cell_of(axis, entry);
+            if (direction[axis] > 0.0) {
+                const value_type boundary = box_.min()[axis] + (cell[axis] + 1) * cell_size_[axis];
+                next_crossing[axis] = t_enter + (boundary - entry) * inverse_ray.inverse_direction[axis];
+                crossing_delta[axis] = cell_size_[axis] * inverse_ray.inverse_direction[axis];
+                step[axis] = 1;
+                end[axis] = resolution_[axis];
+            } else if (direction[axis] < 0.0) {
+                const value_type boundary = box_.min()[axis] + cell[axis] * cell_size_[axis];
+                next_crossing[axis] = t_enter + (boundary - entry) * inverse_ray.inverse_direction[axis];
+                crossing_delta[axis] = -cell_size_[axis] * inverse_ray.inverse_direction[axis];
+                step[axis] = -1;
+                end[axis] = -1;
+            } else {
+                next_crossing[axis] = std::numeric_limits<value_type>::infinity();
+                crossing_delta[axis] = 0.0;
+                step[axis] = 0;
+                end[axis] = -1;
+            }
+        }
+
+        while (true) {
+            if constexpr (collect_traversal_statistics) ++traversal_statistics().nodes_visited;
+            if (visit((cell[2] * resolution_[1] + cell[1]) * resolution_[0] + cell[0])) return true;
+            const int axis = next_crossing[0] < next_crossing[1]
+                    ? (next_crossing[0] < next_crossing[2] ? 0 : 2)
+                    : (next_crossing[1] < next_crossing[2] ? 1 : 2);
+            if (t_max < next_crossing[axis]) return false;
+            cell[axis] += step[axis];
+            if (cell[axis] == end[axis]) return false;
+            next_crossing[axis] += crossing_delta[axis];
+        }
+    }
+
+    // The hittables with a bounding box, indexed by the cell lists.
+    std::vector<std::shared_ptr<const Hittable>> bounded_;
+    // The hittables without a bounding box.
+    HittableWorld unbounded_;
+    // The box surrounding every bounded hittable, which the cells divide.
+    AxisAlignedBoundingBox box_;
+    int resolution_[3] = {0, 0, 0};
+    value_type cell_size_[3];
+    value_type inverse_cell_size_[3];
+    // The hittables of cell c are cell_hittables_[cell_offsets_[c]] to cell_hittables_[cell_offsets_[c + 1] - 1].
+    // Cells are numbered x first, then y, then z.
+    std::vector<int> cell_offsets_;
+    std::vector<int> cell_hittables_;
+};
+
+#endif //RAYTRACING_UNIFORMGRID_H
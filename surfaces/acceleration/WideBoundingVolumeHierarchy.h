@@ -0,0 +1,378 @@
+#ifndef RAYTRACING_WIDEBOUNDINGVOLUMEHIERARCHY_H
+#define RAYTRACING_WIDEBOUNDINGVOLUMEHIERARCHY_H
+#include "../Hittable.h"
+#include "../HittableWorld.h"
+#include "LinearBoundingVolumeHierarchy.h"
+#include "TraversalStatistics.h"
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// The child box tests use SSE or AVX when the compiler targets them, unless RAYTRACING_DISABLE_SIMD is
+// defined. Otherwise they fall back to a scalar loop. AVX is only enabled by compiling for it, e.g.
+// with the RAYTRACING_NATIVE_ARCHITECTURE CMake option.
+#if !defined(RAYTRACING_DISABLE_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define RAYTRACING_WIDE_BVH_AVX
+#elif !defined(RAYTRACING_DISABLE_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define RAYTRACING_WIDE_BVH_SSE
+#endif
+
+// A node of a wide bounding volume hierarchy, holding the boxes of up to Width children in
+// structure-of-arrays form, so that one ray can be tested against all of them at once.
+// Children are packed at the front; slots past 'child_count' are unused.
+template <int Width>
+struct alignas(32) WideBVHNode {
+    value_type min_x[Width], min_y[Width], min_z[Width];
+    value_type max_x[Width], max_y[Width], max_z[Width];
+    // For an interior child, the index of its node. For a leaf child, the position of its first primitive.
+    int32_t child[Width];
+    // The number of primitives of a leaf child, or 0 for an interior child.
+    int32_t primitive_count[Width];
+    int32_t child_count;
+};
+
+// Tests 'ray' against every child box of 'node' over [t_min, t_max]. Returns a bit mask of the
+// children that were hit, and writes the entry distance of each child into 't_near'.
+template <int Width>
+inline int intersect_children(const WideBVHNode<Width>& node, const InverseRay& ray,
+                              value_type t_min, value_type t_max, value_type t_near[Width]) {
+    // The near and far planes of every child along an axis only depend on the sign of the ray direction.
+    const value_type* near_x = ray.is_negative[0] ? node.max_x : node.min_x;
+    const value_type* far_x = ray.is_negative[0] ? node.min_x : node.max_x;
+    const value_type* near_y = ray.is_negative[1] ? node.max_y : node.min_y;
+    const value_type* far_y = ray.is_negative[1] ? node.min_y : node.max_y;
+    const value_type* near_z = ray.is_negative[2] ? node.max_z : node.min_z;
+    const value_type* far_z = ray.is_negative[2] ? node.min_z : node.max_z;
+    const int valid = (1 << node.child_count) - 1;
+    int mask = 0;
+
+#if defined(RAYTRACING_WIDE_BVH_AVX) || defined(RAYTRACING_WIDE_BVH_SSE)
+    if constexpr (std::is_same_v<value_type, double>) {
+        // As in AxisAlignedBoundingBox::hit, the slab distances are the first operand of max and min,
+        // which return their second operand when either is NaN.
+#if defined(RAYTRACING_WIDE_BVH_AVX)
+        constexpr int lanes = 4;
+        const __m256d origin_x = _mm256_set1_pd(ray.origin.x());
+        const __m256d origin_y = _mm256_set1_pd(ray.origin.y());
+        const __m256d origin_z = _mm256_set1_pd(ray.origin.z());
+        const __m256d inverse_x = _mm256_set1_pd(ray.inverse_direction.x());
+        const __m256d inverse_y = _mm256_set1_pd(ray.inverse_direction.y());
+        const __m256d inverse_z = _mm256_set1_pd(ray.inverse_direction.z());
+        const __m256d minimum = _mm256_set1_pd(t_min);
+        const __m256d maximum = _mm256_set1_pd(t_max);
+        for (int base = 0; base < Width; base += lanes) {
+            const __m256d tx0 = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(near_x + base), origin_x), inverse_x);
+            const __m256d tx1 = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(far_x + base), origin_x), inverse_x);
+            const __m256d ty0 = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(near_y + base), origin_y), inverse_y);
+            const __m256d ty1 = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(far_y + base), origin_y), inverse_y);
+            const __m256d tz0 = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(near_z + base), origin_z), inverse_z);
+            const __m256d tz1 = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(far_z + base), origin_z), inverse_z);
+            const __m256d enter = _mm256_max_pd(tz0, _mm256_max_pd(ty0, _mm256_max_pd(tx0, minimum)));
+            const __m256d exit = _mm256_min_pd(tz1, _mm256_min_pd(ty1, _mm256_min_pd(tx1, maximum)));
+            _mm256_storeu_pd(t_near + base, enter);
+            mask |= _mm256_movemask_pd(_mm256_cmp_pd(enter, exit, _CMP_LT_OQ)) << base;
+        }
+#else
+        constexpr int lanes = 2;
+        const __m128d origin_x = _mm_set1_pd(ray.origin.x());
+        const __m128d origin_y = _mm_set1_pd(ray.origin.y());
+        const __m128d origin_z = _mm_set1_pd(ray.origin.z());
+        const __m128d inverse_x = _mm_set1_pd(ray.inverse_direction.x());
+        const __m128d inverse_y = _mm_set1_pd(ray.inverse_direction.y());
+        const __m128d inverse_z = _mm_set1_pd(ray.inverse_direction.z());
+        const __m128d minimum = _mm_set1_pd(t_min);
+        const __m128d maximum = _mm_set1_pd(t_max);
+        for (int base = 0; base < Width; base += lanes) {
+            const __m128d tx0 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(near_x + base), origin_x), inverse_x);
+            const __m128d tx1 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(far_x + base), origin_x), inverse_x);
+            const __m128d ty0 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(near_y + base), origin_y), inverse_y);
+            const __m128d ty1 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(far_y + base), origin_y), inverse_y);
+            const __m128d tz0 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(near_z + base), origin_z), inverse_z);
+            const __m128d tz1 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(far_z + base), origin_z), inverse_z);
+            const __m128d enter = _mm_max_pd(tz0, _mm_max_pd(ty0, _mm_max_pd(tx0, minimum)));
+            const __m128d exit = _mm_min_pd(tz1, _mm_min_pd(ty1, _mm_min_pd(tx1, maximum)));
+            _mm_storeu_pd(t_near + base, enter);
+            mask |= _mm_movemask_pd(_mm_cmplt_pd(enter, exit)) << base;
+        }
+#endif
+        return mask & valid;
+    }
+#endif
+
+    for (int i = 0; i < Width; ++i) {
+        const value_type tx0 = (near_x[i] - ray.origin.x()) * ray.inverse_direction.x();
+        const value_type tx1 = (far_x[i] - ray.origin.x()) * ray.inverse_direction.x();
+        const value_type ty0 = (near_y[i] - ray.origin.y()) * ray.inverse_direction.y();
+        const value_type ty1 = (far_y[i] - ray.origin.y()) * ray.inverse_direction.y();
+        const value_type tz0 = (near_z[i] - ray.origin.z()) * ray.inverse_direction.z();
+        const value_type tz1 = (far_z[i] - ray.origin.z()) * ray.inverse_direction.z();
+        const value_type enter = get_max(tz0, get_max(ty0, get_max(tx0, t_min)));
+        const value_type exit = get_min(tz1, get_min(ty1, get_min(tx1, t_max)));
+        t_near[i] = enter;
+        mask |= int(enter < exit) << i;
+    }
+    return mask & valid;
+}
+
+// A bounding volume hierarchy whose nodes have up to Width (4 or 8) children, tested against a ray
+// together by intersect_children. It is built by collapsing a binary LinearBVHTree: each wide node
+// takes a binary node's children, and repeatedly replaces the interior child with the largest surface
+// area by its own two children until Width children are gathered. The wide tree is therefore
+// several times shallower, and a ray visits fewer, larger nodes.
+// Leaves refer to ranges of ordered_indices(), as in LinearBVHTree.
+template <int Width>
+class WideBVHTree {
+    static_assert(Width == 4 || Width == 8, "WideBVHTree supports 4 or 8 children per node.");
+public:
+    WideBVHTree() {}
+
+    explicit WideBVHTree(std::vector<BuildPrimitive> primitives) {
+        const LinearBVHTree binary(std::move(primitives));
+        if (binary.empty()) return;
+        ordered_indices_ = binary.ordered_indices();
+        nodes_.reserve(binary.nodes().size() / (Width / 2) + 1);
+        if (binary.nodes().front().primitive_count > 0) {
+            // A single leaf still needs a node to hold its box.
+            nodes_.emplace_back();
+            initialize(nodes_.back());
+            set_child(nodes_.back(), 0, binary.nodes().front(), binary.nodes().front().offset);
+            nodes_.back().child_count = 1;
+        } else {
+            collapse(binary, 0);
+        }
+    }
+
+    bool empty() const { return nodes_.empty(); }
+
+    const std::vector<WideBVHNode<Width>>& nodes() const { return nodes_; }
+
+    const std::vector<int>& ordered_indices() const { return ordered_indices_; }
+
+    // Returns the box surrounding every primitive in the tree.
+    AxisAlignedBoundingBox bounds() const {
+        const WideBVHNode<Width>& root = nodes_.front();
+        AxisAlignedBoundingBox box = child_box(root, 0);
+        for (int i = 1; i < root.child_count; ++i) {
+            box = AxisAlignedBoundingBox::surrounding_box(box, child_box(root, i));
+        }
+        return box;
+    }
+
+    // Walks the tree with an explicit stack. At each node, the children hit by the ray are visited from
+    // nearest to farthest. 'intersect' has the same contract as in LinearBVHTree::traverse.
+    template <typename Intersector>
+    bool traverse(const InverseRay& ray, value_type t_min, value_type& t_max, Intersector&& intersect) const {
+        if (nodes_.empty()) return false;
+        bool hit_anything = false;
+        int stack[LinearBVHTree::max_depth * Width];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const WideBVHNode<Width>& node = nodes_[stack[--stack_size]];
+            if constexpr (collect_traversal_statistics) ++traversal_statistics().nodes_visited;
+            value_type t_near[Width];
+            int mask = intersect_children<Width>(node, ray, t_min, t_max, t_near);
+            if (mask == 0) continue;
+
+            // Sort the children that were hit by entry distance, nearest first.
+            int order[Width];
+            int hit_count = 0;
+            for (; mask != 0; mask &= mask - 1) {
+                const int child = __builtin_ctz(mask);
+                int position = hit_count++;
+                while (position > 0 && t_near[order[position - 1]] > t_near[child]) {
+                    order[position] = order[position - 1];
+                    --position;
+                }
+                order[position] = child;
+            }
+
+            // Leaves are intersected right away, nearest first, so that they can shorten t_max for
+            // the rest. Interior children are pushed farthest first, so the nearest is popped first.
+            for (int i = 0; i < hit_count; ++i) {
+                const int child = order[i];
+                if (node.primitive_count[child] == 0 || t_near[child] >= t_max) continue;
+                for (int p = node.child[child]; p < node.child[child] + node.primitive_count[child]; ++p) {
+                    if constexpr (collect_traversal_statistics) ++traversal_statistics().primitives_tested;
+                    if (intersect(p, t_min, t_max)) hit_anything = true;
+                }
+            }
+            for (int i = hit_count - 1; i >= 0; --i) {
+                const int child = order[i];
+                if (node.primitive_count[child] == 0 && t_near[child] < t_max) {
+                    stack[stack_size++] = node.child[child];
+                }
+            }
+        }
+        return hit_anything;
+    }
+
+    // The any-hit form of traverse(), for occlusion queries. Since t_max never shrinks, the children hit
+    // are not sorted; the walk stops at the first primitive for which 'occluded(position, t_min, t_max)'
+    // returns true.
+    template <typename OcclusionTest>
+    bool traverse_any(const InverseRay& ray, value_type t_min, value_type t_max, OcclusionTest&& occluded) const {
+        if (nodes_.empty()) return false;
+        int stack[LinearBVHTree::max_depth * Width];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const WideBVHNode<Width>& node = nodes_[stack[--stack_size]];
+            if constexpr (collect_traversal_statistics) ++traversal_statistics().nodes_visited;
+            value_type t_near[Width];
+            for (int mask = intersect_children<Width>(node, ray, t_min, t_max, t_near); mask != 0; mask &= mask - 1) {
+                const int child = __builtin_ctz(mask);
+                if (node.primitive_count[child] == 0) {
+                    stack[stack_size++] = node.child[child];
+                    continue;
+                }
+                for (int p = node.child[child]; p < node.child[child] + node.primitive_count[child]; ++p) {
+                    if constexpr (collect_traversal_statistics) ++traversal_statistics().primitives_tested;
+                    if (occluded(p, t_min, t_max)) return true;
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    // Marks every child slot of 'node' as unused, with an inverted box no ray can hit.
+    static void initialize(WideBVHNode<Width>& node) {
+        for (int i = 0; i < Width; ++i) {
+            node.min_x[i] = node.min_y[i] = node.min_z[i] = std::numeric_limits<value_type>::max();
+            node.max_x[i] = node.max_y[i] = node.max_z[i] = -std::numeric_limits<value_type>::max();
+            node.child[i] = -1;
+            node.primitive_count[i] = 0;
+        }
+        node.child_count = 0;
+    }
+
+    static void set_child(WideBVHNode<Width>& node, int slot, const LinearBVHNode& binary_node, int child) {
+        const BoundVec3 min = binary_node.box.min();
+        const BoundVec3 max = binary_node.box.max();
+        node.min_x[slot] = min.x();
+        node.min_y[slot] = min.y();
+        node.min_z[slot] = min.z();
+        node.max_x[slot] = max.x();
+        node.max_y[slot] = max.y();
+        node.max_z[slot] = max.z();
+        node.child[slot] = child;
+        node.primitive_count[slot] = binary_node.primitive_count;
+    }
+
+    static AxisAlignedBoundingBox child_box(const WideBVHNode<Width>& node, int slot) {
+        return AxisAlignedBoundingBox(BoundVec3(node.min_x[slot], node.min_y[slot], node.min_z[slot]),
+                                      BoundVec3(node.max_x[slot], node.max_y[slot], node.max_z[slot]));
+    }
+
+    // Appends the wide node for the binary interior node 'index', and its subtree, returning its index.
+    int collapse(const LinearBVHTree& binary, int index) {
+        const std::vector<LinearBVHNode>& binary_nodes = binary.nodes();
+        // The first child of a binary interior node is the node directly after it.
+        int children[Width] = {index + 1, binary_nodes[index].offset};
+        int child_count = 2;
+        while (child_count < Width) {
+            int largest = -1;
+            value_type largest_area = -1.0;
+            for (int i = 0; i < child_count; ++i) {
+                const LinearBVHNode& child = binary_nodes[children[i]];
+                if (child.primitive_count == 0 && child.box.surface_area() > largest_area) {
+                    largest = i;
+                    largest_area = child.box.surface_area();
+                }
+            }
+            if (largest < 0) break; // Every child is a leaf.
+            const int expanded = children[largest];
+            children[largest] = expanded + 1;
+            children[child_count++] = binary_nodes[expanded].offset;
+        }
+
+        const int wide_index = nodes_.size();
+        nodes_.emplace_back();
+        initialize(nodes_[wide_index]);
+        nodes_[wide_index].child_count = child_count;
+        for (int i = 0; i < child_count; ++i) {
+            const LinearBVHNode& child = binary_nodes[children[i]];
+            // Collapsing may reallocate nodes_, so the wide node is looked up again after each child.
+            const int wide_child = child.primitive_count > 0 ? child.offset : collapse(binary, children[i]);
+            set_child(nodes_[wide_index], i, child, wide_child);
+        }
+        return wide_index;
+    }
+
+    std::vector<WideBVHNode<Width>> nodes_;
+    std::vector<int> ordered_indices_;
+};
+
+// A wide bounding volume hierarchy over a collection of hittables (see WideBVHTree).
+// Hittables without a bounding box are tested on every ray.
+template <int Width>
+class WideBoundingVolumeHierarchy : public Hittable {
+public:
+    // Builds the hierarchy over the hittables of 'world'. The boxes are taken over
+    // the shutter interval [t0, t1].
+    WideBoundingVolumeHierarchy(const HittableWorld& world, value_type t0, value_type t1)
+            : WideBoundingVolumeHierarchy(world.hittables(), t0, t1) {}
+
+    WideBoundingVolumeHierarchy(const std::vector<std::shared_ptr<const Hittable>>& hittables,
+                                value_type t0, value_type t1) {
+        std::vector<BuildPrimitive> primitives;
+        primitives.reserve(hittables.size());
+        for (int i = 0; i < hittables.size(); ++i) {
+            AxisAlignedBoundingBox box;
+            if (hittables[i]->bounding_box(t0, t1, box)) {
+                primitives.push_back(BuildPrimitive{box, box.centroid(), i});
+            } else {
+                unbounded_.add(hittables[i]);
+            }
+        }
+        tree_ = WideBVHTree<Width>(std::move(primitives));
+        ordered_hittables_.reserve(tree_.ordered_indices().size());
+        for (const int index : tree_.ordered_indices()) {
+            ordered_hittables_.push_back(hittables[index]);
+        }
+    }
+
+    bool hit(const Ray& ray, value_type t_min, value_type t_max, HitRecord& record) const override {
+        const InverseRay inverse_ray(ray);
+        bool hit_anything = tree_.traverse(inverse_ray, t_min, t_max,
+                [&](int position, value_type t_min, value_type& t_max) {
+            if (ordered_hittables_[position]->hit(ray, t_min, t_max, record)) {
+                t_max = record.hit_point;
+                return true;
+            }
+            return false;
+        });
+        if (unbounded_.hit(ray, t_min, t_max, record)) {
+            hit_anything = true;
+        }
+        return hit_anything;
+    }
+
+    bool occluded(const Ray& ray, value_type t_min, value_type t_max) const override {
+        const InverseRay inverse_ray(ray);
+        return tree_.traverse_any(inverse_ray, t_min, t_max,
+                [&](int position, value_type t_min, value_type t_max) {
+            return ordered_hittables_[position]->occluded(ray, t_min, t_max);
+        }) || unbounded_.occluded(ray, t_min, t_max);
+    }
+
+    bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
+        if (tree_.empty() || unbounded_.size() > 0) return false;
+        box = tree_.bounds();
+        return true;
+    }
+
+private:
+    WideBVHTree<Width> tree_;
+    // The hittables in tree order, so that each leaf refers to a contiguous range.
+    std::vector<std::shared_ptr<const Hittable>> ordered_hittables_;
+    // The hittables without a bounding box.
+    HittableWorld unbounded_;
+};
+
+#endif //RAYTRACING_WIDEBOUNDINGVOLUMEHIERARCHY_H
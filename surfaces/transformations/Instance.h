@@ -0,0 +1,109 @@
+#ifndef RAYTRACING_INSTANCE_H
+#define RAYTRACING_INSTANCE_H
+#include "../Hittable.h"
+#include "../../utility/AffineTransform.h"
+#include <cmath>
+#include <limits>
+#include <memory>
+
+// Places a shared hittable into the world with an affine transformation. Any number of instances
+// may refer to the same hittable (e.g. a mesh, or a hierarchy over many surfaces), so each extra
+// copy only costs the two matrices. A ray is carried into the hittable's own space with one
+// multiplication by the inverse matrix, rather than once per Translate or Rotate wrapper.
+// For a two-level structure, build a LinearBoundingVolumeHierarchy over the instances.
+class Instance : public Hittable {
+public:
+    Instance(std::shared_ptr<const Hittable> hittable_pointer, const AffineTransform& object_to_world) :
+            hittable_pointer_{hittable_pointer}, object_to_world_{object_to_world},
+            world_to_object_{object_to_world.inverse()} {
+        // Rotations and translations keep lengths, so rays and normals need no rescaling.
+        preserves_lengths_ = true;
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                const value_type dot = object_to_world(0, i) * object_to_world(0, j)
+                                     + object_to_world(1, i) * object_to_world(1, j)
+                                     + object_to_world(2, i) * object_to_world(2, j);
+                if (std::fabs(dot - (i == j ? 1.0 : 0.0)) > 1e-9) preserves_lengths_ = false;
+            }
+        }
+
+        AxisAlignedBoundingBox box;
+        has_box_ = hittable_pointer->bounding_box(0.0, 1.0, box);
+        if (has_box_) bounding_box_ = transform_box(box);
+    }
+
+    // Distances along the ray are measured in world units outside and in object units inside, so
+    // with a scaling transformation they are converted by the length of the transformed direction.
+    virtual bool hit(const Ray& ray, value_type t_min, value_type t_max, HitRecord& record) const override {
+        const FreeVec3 direction = world_to_object_.apply(ray.direction().to_free());
+        const value_type scale = preserves_lengths_ ? 1.0 : direction.length();
+        const Ray object_ray(world_to_object_.apply(ray.origin()), UnitVec3(direction), ray.time());
+        const value_type object_t_max = t_max < std::numeric_limits<value_type>::max() ? t_max * scale : t_max;
+        if (!hittable_pointer_->hit(object_ray, t_min * scale, object_t_max, record)) return false;
+
+        record.hit_point /= scale;
+        record.point_at_parameter = object_to_world_.apply(record.point_at_parameter);
+        record.normal = world_to_object_.apply_transpose(record.normal);
+        if (!preserves_lengths_) record.normal = UnitVec3(record.normal).to_free();
+        return true;
+    }
+
+    virtual bool occluded(const Ray& ray, value_type t_min, value_type t_max) const override {
+        const FreeVec3 direction = world_to_object_.apply(ray.direction().to_free());
+        const value_type scale = preserves_lengths_ ? 1.0 : direction.length();
+        const Ray object_ray(world_to_object_.apply(ray.origin()), UnitVec3(direction), ray.time());
+        const value_type object_t_max = t_max < std::numeric_limits<value_type>::max() ? t_max * scale : t_max;
+        return hittable_pointer_->occluded(object_ray, t_min * scale, object_t_max);
+    }
+
+    // The box over the usual shutter interval [0, 1] is computed once; that over any other is transformed
+    // from the hittable's box over it on each call.
+    virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const override {
+        if (t0 == 0.0 && t1 == 1.0) {
+            box = bounding_box_;
+            return has_box_;
+        }
+        AxisAlignedBoundingBox object_box;
+        if (!hittable_pointer_->bounding_box(t0, t1, object_box)) return false;
+        box = transform_box(object_box);
+        return true;
+    }
+
+private:
+    // Produces the box surrounding the eight transformed corners of 'box'.
+    AxisAlignedBoundingBox transform_box(const AxisAlignedBoundingBox& box) const {
+        BoundVec3 min(std::numeric_limits<value_type>::max(),
+                      std::numeric_limits<value_type>::max(),
+                      std::numeric_limits<value_type>::max());
+        BoundVec3 max(-std::numeric_limits<value_type>::max(),
+                      -std::numeric_limits<value_type>::max(),
+                      -std::numeric_limits<value_type>::max());
+        for (int i = 0; i < 2; ++i) {
+            for (int j = 0; j < 2; ++j) {
+                for (int k = 0; k < 2; ++k) {
+                    const BoundVec3 corner = object_to_world_.apply(
+                            BoundVec3(i ? box.max().x() : box.min().x(),
+                                      j ? box.max().y() : box.min().y(),
+                                      k ? box.max().z() : box.min().z()));
+                    min = BoundVec3(get_min(min.x(), corner.x()), get_min(min.y(), corner.y()),
+                                    get_min(min.z(), corner.z()));
+                    max = BoundVec3(get_max(max.x(), corner.x()), get_max(max.y(), corner.y()),
+                                    get_max(max.z(), corner.z()));
+                }
+            }
+        }
+        return AxisAlignedBoundingBox(min, max);
+    }
+
+    // The shared hittable, in its own (object) space.
+    std::shared_ptr<const Hittable> hittable_pointer_;
+    // Maps object space to world space, and back.
+    AffineTransform object_to_world_;
+    AffineTransform world_to_object_;
+    // Whether the transformation is rigid, i.e. keeps lengths and angles.
+    bool preserves_lengths_;
+    bool has_box_;
+    AxisAlignedBoundingBox bounding_box_;
+};
+
+#endif //RAYTRACING_INSTANCE_H
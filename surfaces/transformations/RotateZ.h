@@ -57,15 +57,7 @@ public:
     }
 
     virtual bool hit(const Ray& ray, value_type t_min, value_type t_max, HitRecord& record) const {
-        BoundVec3 origin = ray.origin();
-        FreeVec3 direction = ray.direction().to_free();
-        origin.x() = cos_theta_ * ray.origin().x() - sin_theta_ * ray.origin().y();
-        origin.y() = sin_theta_ * ray.origin().x() + cos_theta_ * ray.origin().y();
-
-        direction.x() = cos_theta_ * ray.direction().x() - sin_theta_ * ray.direction().y();
-        direction.y() = sin_theta_ * ray.direction().x() + cos_theta_ * ray.direction().y();
-
-        const Ray rotated_ray(origin, UnitVec3(direction), ray.time());
+        const Ray rotated_ray = rotate(ray);
         if (hittable_pointer_->hit(rotated_ray, t_min, t_max, record)) {
             BoundVec3 point_at_parameter = record.point_at_parameter;
             FreeVec3 normal = record.normal;
@@ -85,12 +77,29 @@ public:
         return false;
     }
 
+    virtual bool occluded(const Ray& ray, value_type t_min, value_type t_max) const {
+        return hittable_pointer_->occluded(rotate(ray), t_min, t_max);
+    }
+
     virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const {
         box = bounding_box_;
         return has_box_;
     }
 
 private:
+    // Carries 'ray' into the space of the rotated hittable.
+    Ray rotate(const Ray& ray) const {
+        BoundVec3 origin = ray.origin();
+        FreeVec3 direction = ray.direction().to_free();
+        origin.x() = cos_theta_ * ray.origin().x() - sin_theta_ * ray.origin().y();
+        origin.y() = sin_theta_ * ray.origin().x() + cos_theta_ * ray.origin().y();
+
+        direction.x() = cos_theta_ * ray.direction().x() - sin_theta_ * ray.direction().y();
+        direction.y() = sin_theta_ * ray.direction().x() + cos_theta_ * ray.direction().y();
+
+        return Ray(origin, UnitVec3(direction), ray.time());
+    }
+
     std::shared_ptr<const Hittable> hittable_pointer_;
     value_type sin_theta_;
     value_type cos_theta_;
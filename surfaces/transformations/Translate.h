@@ -19,6 +19,11 @@ public:
         return false;
     }
 
+    virtual bool occluded(const Ray& ray, value_type t_min, value_type t_max) const {
+        const Ray moved_ray(ray.origin() - offset_, ray.direction(), ray.time());
+        return hittable_pointer_->occluded(moved_ray, t_min, t_max);
+    }
+
     virtual bool bounding_box(value_type t0, value_type t1, AxisAlignedBoundingBox& box) const {
         if (hittable_pointer_->bounding_box(t0, t1, box)) {
             box = AxisAlignedBoundingBox(box.min() + offset_, box.max() + offset_);
@@ -0,0 +1,90 @@
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../utility/Vec3.h"
+#include "../utility/Ray.h"
+#include "../surfaces/HittableWorld.h"
+#include "../surfaces/Sphere.h"
+#include "../surfaces/TriangleMesh.h"
+#include "../surfaces/acceleration/LinearBoundingVolumeHierarchy.h"
+#include "../surfaces/acceleration/WideBoundingVolumeHierarchy.h"
+#include "../material/Lambertian.h"
+#include "../material/texture/ConstantTexture.h"
+
+// Checks the acceleration structures on degenerate input. Exits with a nonzero status if any check fails.
+
+int failures = 0;
+
+void check(bool condition, const std::string& description) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", description.c_str());
+        ++failures;
+    }
+}
+
+// The number of levels of 'tree', where a lone leaf is one level.
+int depth_of(const LinearBVHTree& tree, int node = 0) {
+    const LinearBVHNode& current = tree.nodes()[node];
+    if (current.primitive_count > 0) return 1;
+    return 1 + std::max(depth_of(tree, node + 1), depth_of(tree, current.offset));
+}
+
+// Boxes that all coincide, as with duplicate faces in a mesh.
+std::vector<BuildPrimitive> coincident_boxes(int count) {
+    const AxisAlignedBoundingBox box(BoundVec3(-1.0, -1.0, -1.0), BoundVec3(1.0, 1.0, 1.0));
+    std::vector<BuildPrimitive> primitives;
+    for (int i = 0; i < count; ++i) {
+        primitives.push_back(BuildPrimitive{box, box.centroid(), i});
+    }
+    return primitives;
+}
+
+int main() {
+    const auto material = std::make_shared<Lambertian>(
+            Lambertian(std::make_shared<ConstantTexture>(ConstantTexture(Color3(0.5, 0.5, 0.5)))));
+
+    // Coincident primitives give the surface area heuristic nothing to choose between, but the tree must
+    // still be shallow enough for the traversal stacks.
+    for (const int count : {2, 5, 64, 65, 300, 5000}) {
+        const LinearBVHTree tree(coincident_boxes(count), SURFACE_AREA_HEURISTIC);
+        check(depth_of(tree) <= LinearBVHTree::max_depth,
+              std::to_string(count) + " coincident boxes build a tree of depth at most max_depth");
+        // Every split of coincident boxes costs the same, so the even ones make a tree of logarithmic depth.
+        check(depth_of(tree) <= 2 + int(std::log2(count)),
+              std::to_string(count) + " coincident boxes are split evenly");
+    }
+
+    HittableWorld spheres;
+    for (int i = 0; i < 300; ++i) {
+        spheres.add(std::make_shared<Sphere>(Sphere(BoundVec3(0.0, 0.0, 0.0), 1.0, material)));
+    }
+    const LinearBoundingVolumeHierarchy hierarchy(spheres, 0.0, 1.0);
+    const WideBoundingVolumeHierarchy<4> wide_hierarchy(spheres, 0.0, 1.0);
+    for (const value_type direction : {-1.0, 1.0}) {
+        const Ray ray(BoundVec3(-5.0 * direction, 0.0, 0.0), UnitVec3(direction, 0.0, 0.0), 0.0);
+        HitRecord record;
+        check(hierarchy.hit(ray, 0.001, 100.0, record) && std::abs(record.hit_point - 4.0) < 1e-9,
+              "a ray hits the nearest of 300 coincident spheres through the linear hierarchy");
+        check(wide_hierarchy.hit(ray, 0.001, 100.0, record) && std::abs(record.hit_point - 4.0) < 1e-9,
+              "a ray hits the nearest of 300 coincident spheres through the wide hierarchy");
+        check(hierarchy.occluded(ray, 0.001, 100.0), "300 coincident spheres occlude a ray");
+    }
+
+    // A mesh whose faces are all the same triangle.
+    std::vector<BoundVec3> positions = {BoundVec3(0.0, -1.0, -1.0), BoundVec3(0.0, 1.0, -1.0),
+                                        BoundVec3(0.0, 0.0, 1.0)};
+    std::vector<int> indices;
+    for (int i = 0; i < 2000; ++i) {
+        indices.insert(indices.end(), {0, 1, 2});
+    }
+    const TriangleMesh mesh(positions, indices, material);
+    const Ray ray(BoundVec3(3.0, 0.0, 0.0), UnitVec3(-1.0, 0.0, 0.0), 0.0);
+    HitRecord record;
+    check(mesh.hit(ray, 0.001, 100.0, record) && std::abs(record.hit_point - 3.0) < 1e-9,
+          "a ray hits a mesh of 2000 duplicate faces");
+
+    if (failures == 0) std::printf("All acceleration checks passed.\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../utility/MeshImport.h"
+
+// Checks MeshImporter on binary PLY and OBJ files built in memory. Exits with a nonzero status if any check fails.
+
+int failures = 0;
+
+void check(bool condition, const std::string& description) {
+    if (!condition) {
+        std::printf("FAILED: %s\n", description.c_str());
+        ++failures;
+    }
+}
+
+template<typename T>
+void append(std::string& data, T value) {
+    data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// A little endian PLY file of a row of 'vertex_count' vertices and the given faces.
+std::string ply_file(int vertex_count, const std::vector<std::vector<int32_t>>& faces) {
+    std::string data = "ply\nformat binary_little_endian 1.0\nelement vertex " + std::to_string(vertex_count)
+                       + "\nproperty float x\nproperty float y\nproperty float z\nelement face "
+                       + std::to_string(faces.size()) + "\nproperty list uchar int vertex_indices\nend_header\n";
+    for (int i = 0; i < vertex_count; ++i) {
+        append(data, float(i));
+        append(data, 0.0f);
+        append(data, 0.0f);
+    }
+    for (const std::vector<int32_t>& face : faces) {
+        append(data, uint8_t(face.size()));
+        for (const int32_t index : face) {
+            append(data, index);
+        }
+    }
+    return data;
+}
+
+// The triangles MeshImporter should split 'faces' into.
+std::vector<int> fan_triangles(const std::vector<std::vector<int32_t>>& faces) {
+    std::vector<int> indices;
+    for (const std::vector<int32_t>& face : faces) {
+        for (std::size_t k = 2; k < face.size(); ++k) {
+            indices.insert(indices.end(), {face[0], face[k - 1], face[k]});
+        }
+    }
+    return indices;
+}
+
+// The position, texture coordinates, and normal of each triangle corner of 'mesh', in order, as
+// {x, y, z, u, v, nx, ny, nz}, with zeros for what the mesh has not got.
+std::vector<std::vector<value_type>> corners_of(const MeshData& mesh) {
+    std::vector<std::vector<value_type>> corners;
+    for (const int vertex : mesh.indices) {
+        const BoundVec3& position = mesh.positions[vertex];
+        std::vector<value_type> corner = {position.x(), position.y(), position.z(), 0, 0, 0, 0, 0};
+        if (!mesh.uvs.empty()) {
+            corner[3] = mesh.uvs[2 * vertex];
+            corner[4] = mesh.uvs[2 * vertex + 1];
+        }
+        if (!mesh.normals.empty()) {
+            corner[5] = mesh.normals[vertex].x();
+            corner[6] = mesh.normals[vertex].y();
+            corner[7] = mesh.normals[vertex].z();
+        }
+        corners.push_back(corner);
+    }
+    return corners;
+}
+
+MeshData read_obj(MeshImporter& importer, const std::string& text) {
+    return importer.read_obj(text.data(), text.size());
+}
+
+// Whether reading 'text' as an OBJ file is rejected.
+bool obj_is_rejected(MeshImporter& importer, const std::string& text) {
+    try {
+        read_obj(importer, text);
+    } catch (const std::invalid_argument&) {
+        return true;
+    }
+    return false;
+}
+
+void check_obj(MeshImporter& importer) {
+    const std::string square = "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n";
+
+    // A quad is split into a fan, and negative indices count back from the last position.
+    const MeshData quad = read_obj(importer, square + "f -4 -3 -2 -1 # a quad\n");
+    check(quad.positions.size() == 4 && quad.uvs.empty() && quad.normals.empty(), "an OBJ quad keeps its positions");
+    check(quad.indices == std::vector<int>({0, 1, 2, 0, 2, 3}), "an OBJ quad with negative indices is a fan");
+
+    // Corners sharing a position but not texture coordinates become separate vertices; corners sharing all
+    // three indices become one.
+    const std::string textured = square + "vt 0 0\nvt 1 1\nvn 0 0 1\n"
+                                 + "f 1/1/1 2/1/1 3/2/1\nf 1/1/1 3/2/1 4/2/1\nf 1/2/1 2/1/1 -1/-2/-1\n";
+    const MeshData textured_mesh = read_obj(importer, textured);
+    check(textured_mesh.positions.size() == 6, "OBJ corners are shared exactly when all their indices are");
+    const std::vector<std::vector<value_type>> expected_textured = {
+            {0, 0, 0, 0, 0, 0, 0, 1}, {1, 0, 0, 0, 0, 0, 0, 1}, {1, 1, 0, 1, 1, 0, 0, 1},
+            {0, 0, 0, 0, 0, 0, 0, 1}, {1, 1, 0, 1, 1, 0, 0, 1}, {0, 1, 0, 1, 1, 0, 0, 1},
+            {0, 0, 0, 1, 1, 0, 0, 1}, {1, 0, 0, 0, 0, 0, 0, 1}, {0, 1, 0, 0, 0, 0, 0, 1}};
+    check(corners_of(textured_mesh) == expected_textured, "OBJ corners keep their texture coordinates and normals");
+
+    // Corners of a position and a normal only, as in "1//2".
+    const MeshData normal_mesh = read_obj(importer, square + "vn 0 0 1\nvn 0 0 -1\nf 1//1 2//1 3//2 4//2\n");
+    check(normal_mesh.uvs.empty() && normal_mesh.normals.size() == normal_mesh.positions.size(),
+          "OBJ corners without texture coordinates keep their normals");
+    const std::vector<std::vector<value_type>> expected_normals = {
+            {0, 0, 0, 0, 0, 0, 0, 1}, {1, 0, 0, 0, 0, 0, 0, 1}, {1, 1, 0, 0, 0, 0, 0, -1},
+            {0, 0, 0, 0, 0, 0, 0, 1}, {1, 1, 0, 0, 0, 0, 0, -1}, {0, 1, 0, 0, 0, 0, 0, -1}};
+    check(corners_of(normal_mesh) == expected_normals, "OBJ corners of the form 1//2 are read");
+
+    // Normals are dropped unless every corner has one.
+    const MeshData partial_normals = read_obj(importer, square + "vn 0 0 1\nf 1//1 2//1 3//1\nf 1 3 4\n");
+    check(partial_normals.normals.empty() && partial_normals.positions.size() == 4,
+          "OBJ normals are dropped when some corner has none");
+
+    // Relative indices are resolved across the chunks parsed in parallel: this file is several chunks long,
+    // and each triangle refers back to the last three positions.
+    std::string long_file;
+    const int position_count = 400000;
+    std::vector<int> expected_indices;
+    for (int i = 0; i < position_count; ++i) {
+        long_file += "v " + std::to_string(i) + " 0 0\n";
+        if (i >= 2) {
+            long_file += "f -3 -2 -1\n";
+            expected_indices.insert(expected_indices.end(), {i - 2, i - 1, i});
+        }
+    }
+    long_file += "f -" + std::to_string(position_count) + " 1 -1\n";
+    expected_indices.insert(expected_indices.end(), {0, 0, position_count - 1});
+    const MeshData long_mesh = read_obj(importer, long_file);
+    check(long_mesh.positions.size() == std::size_t(position_count) && long_mesh.indices == expected_indices,
+          "OBJ relative indices are resolved across chunks");
+    check(long_mesh.positions[position_count - 1].x() == position_count - 1, "OBJ positions are read in order");
+
+    // Indices of vertex data that does not exist are rejected.
+    check(obj_is_rejected(importer, square + "f 1 2 5\n"), "an OBJ position index out of range is rejected");
+    check(obj_is_rejected(importer, square + "f -5 1 2\n"), "an OBJ negative index out of range is rejected");
+    check(obj_is_rejected(importer, square + "vt 0 0\nf 1/1 2/2 3/1\n"),
+          "an OBJ texture coordinate index out of range is rejected");
+    check(obj_is_rejected(importer, square + "f 1 2 0\n"), "an OBJ index of 0 is rejected");
+    check(obj_is_rejected(importer, square + "f 1 2\n"), "an OBJ face of two corners is rejected");
+}
+
+int main() {
+    const int vertex_count = 1 << 16;
+    // The last index of each face ends in the byte 3, so that a record read 4 bytes early, as after a quad,
+    // seems to be a triangle, of indices out of range.
+    std::vector<std::vector<int32_t>> faces;
+    for (int i = 0; i < 400000; ++i) {
+        faces.push_back({i % 251, i % 251 + 1, 256 * (i % 255) + 3});
+    }
+    MeshImporter importer(8);
+    const std::string triangles = ply_file(vertex_count, faces);
+    const MeshData triangle_mesh = importer.read_ply(triangles.data(), triangles.size());
+    check(triangle_mesh.positions.size() == vertex_count, "every PLY vertex is read");
+    check(triangle_mesh.indices == fan_triangles(faces), "PLY triangles are read in order");
+
+    // One quad among the triangles gives the records different sizes, so the parallel pass must give way to
+    // reading the faces one after another, without mistaking misaligned bytes for indices.
+    faces[60000] = {1, 2, 3, 4};
+    const std::string mixed = ply_file(vertex_count, faces);
+    for (int attempt = 0; attempt < 5; ++attempt) {
+        try {
+            const MeshData mixed_mesh = importer.read_ply(mixed.data(), mixed.size());
+            check(mixed_mesh.indices == fan_triangles(faces), "PLY triangles and a quad are read in order");
+        } catch (const std::exception& error) {
+            check(false, std::string("a PLY file of triangles and a quad loads: ") + error.what());
+        }
+    }
+
+    // An index out of range is an error either way.
+    faces[60000] = {1, 2, vertex_count};
+    const std::string out_of_range = ply_file(vertex_count, faces);
+    bool threw = false;
+    try {
+        importer.read_ply(out_of_range.data(), out_of_range.size());
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    check(threw, "a PLY face referring to a missing vertex is rejected");
+
+    check_obj(importer);
+
+    if (failures == 0) std::printf("All mesh import checks passed.\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+#ifndef RAYTRACING_ACCUMULATIONBUFFER_H
+#define RAYTRACING_ACCUMULATIONBUFFER_H
+#include "Vec3.h"
+#include "Framebuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Identifies the render whose samples an AccumulationBuffer holds, and is saved with it, so that samples of
+// different renders are never combined.
+struct AccumulationSource {
+    // The seed of the render's random numbers (see RenderSettings::seed).
+    uint64_t seed = 0;
+    // Identifies the scene, e.g. a hash of its scene file (see SceneFileSettings::scene_hash).
+    uint64_t scene = 0;
+
+    bool operator==(const AccumulationSource& other) const { return seed == other.seed && scene == other.scene; }
+    bool operator!=(const AccumulationSource& other) const { return !(*this == other); }
+};
+
+// Which share of a render divided between worker processes a buffer holds (see TileRenderer::render_share),
+// saved with it so that the shares can be checked to fit together. A render not divided is worker 0 of 1.
+struct AccumulationShare {
+    int32_t worker = 0;
+    int32_t worker_count = 1;
+    // How the render is divided: a RENDER_PARTITION.
+    int32_t partition = 0;
+    // The samples per pixel of the whole render, which a division by sample ranges splits up.
+    int32_t samples_per_pixel = 0;
+
+    // Whether this is a share of the same division of a render as 'other', if not necessarily the same share.
+    bool same_division(const AccumulationShare& other) const {
+        return worker_count == other.worker_count && partition == other.partition
+               && samples_per_pixel == other.samples_per_pixel;
+    }
+};
+
+// The samples of an image rendered progressively, or of one worker's share of a render: for each pixel,
+// the sum of the colors of its samples so far and how many there are. Pixel (i, j) is column i of row j, counted from the bottom left corner
+// as with Framebuffer, and as there, the sums of each channel are kept in a plane of their own.
+// Distinct pixels may be written by different threads at the same time.
+// The buffer can be saved to and loaded from a checkpoint file, so that a render can be resumed.
+class AccumulationBuffer {
+public:
+    AccumulationBuffer(int width, int height, const AccumulationSource& source = AccumulationSource(),
+                       const AccumulationShare& share = AccumulationShare())
+            : width_{width}, height_{height}, source_{source}, share_{share} {
+        if (width <= 0 || height <= 0) {
+            throw std::invalid_argument("AccumulationBuffer dimensions must be positive.");
+        }
+        sums_.resize(3 * std::size_t(width) * height);
+        sample_counts_.resize(std::size_t(width) * height);
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    const AccumulationSource& source() const { return source_; }
+    const AccumulationShare& share() const { return share_; }
+
+    // The number of samples of pixel (i, j), which is also the index of its next sample if its samples
+    // are taken in order.
+    uint32_t sample_count(int i, int j) const { return sample_counts_[j * width_ + i]; }
+
+    // The fewest samples of any pixel.
+    uint32_t minimum_sample_count() const {
+        uint32_t minimum = sample_counts_[0];
+        for (const uint32_t count : sample_counts_) {
+            if (count < minimum) minimum = count;
+        }
+        return minimum;
+    }
+
+    void add_sample(int i, int j, const Color3& color) {
+        const std::size_t index = std::size_t(j) * width_ + i;
+        const std::size_t size = sample_counts_.size();
+        sums_[index] += float(color.r());
+        sums_[size + index] += float(color.g());
+        sums_[2 * size + index] += float(color.b());
+        ++sample_counts_[index];
+    }
+
+    // The average of the samples of pixel (i, j), or black if it has none.
+    Color3 average(int i, int j) const {
+        const std::size_t index = std::size_t(j) * width_ + i;
+        const std::size_t size = sample_counts_.size();
+        if (sample_counts_[index] == 0) return Color3();
+        return Color3(sums_[index], sums_[size + index], sums_[2 * size + index]) / value_type(sample_counts_[index]);
+    }
+
+    // Adds the samples of 'other', which must have the same dimensions and source, to those of this buffer.
+    // This combines the buffers of a render divided between several processes.
+    void merge(const AccumulationBuffer& other) {
+        if (other.width_ != width_ || other.height_ != height_) {
+            throw std::invalid_argument("Only AccumulationBuffers of the same dimensions can be merged.");
+        }
+        if (other.source_ != source_) {
+            throw std::invalid_argument("Only AccumulationBuffers of the same scene and seed can be merged.");
+        }
+        for (std::size_t k = 0; k < sums_.size(); ++k) {
+            sums_[k] += other.sums_[k];
+        }
+        for (std::size_t k = 0; k < sample_counts_.size(); ++k) {
+            sample_counts_[k] += other.sample_counts_[k];
+        }
+    }
+
+    // Writes the average of every pixel to 'framebuffer', which must have the same dimensions.
+    void resolve(Framebuffer& framebuffer) const {
+        if (framebuffer.width() != width_ || framebuffer.height() != height_) {
+            throw std::invalid_argument("Framebuffer dimensions do not match the AccumulationBuffer.");
+        }
+        const std::size_t size = sample_counts_.size();
+        for (int channel = 0; channel < 3; ++channel) {
+            const float* sums = sums_.data() + channel * size;
+            float* averages = framebuffer.plane(channel);
+            for (std::size_t index = 0; index < size; ++index) {
+                averages[index] = sample_counts_[index] > 0 ? float(value_type(sums[index]) / sample_counts_[index]) : 0.0f;
+            }
+        }
+    }
+
+    // Saves the buffer to the checkpoint file 'path'. The file is first written next to 'path' and then
+    // renamed over it, so that a render killed while saving still leaves the previous checkpoint intact.
+    void save(const std::string& path) const {
+        const std::string temporary_path = path + ".tmp";
+        {
+            std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                throw std::runtime_error("Error opening the checkpoint file " + temporary_path + ".");
+            }
+            const int32_t dimensions[2] = {width_, height_};
+            file.write(checkpoint_magic, sizeof(checkpoint_magic));
+            const uint64_t source[2] = {source_.seed, source_.scene};
+            file.write(reinterpret_cast<const char*>(dimensions), sizeof(dimensions));
+            const int32_t share[4] = {share_.worker, share_.worker_count, share_.partition, share_.samples_per_pixel};
+            file.write(reinterpret_cast<const char*>(source), sizeof(source));
+            file.write(reinterpret_cast<const char*>(share), sizeof(share));
+            file.write(reinterpret_cast<const char*>(sample_counts_.data()),
+                       sample_counts_.size() * sizeof(uint32_t));
+            file.write(reinterpret_cast<const char*>(sums_.data()), sums_.size() * sizeof(float));
+            file.flush();
+            if (!file) {
+                throw std::runtime_error("Error writing the checkpoint file " + temporary_path + ".");
+            }
+        }
+        if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Error replacing the checkpoint file " + path + ".");
+        }
+    }
+
+    // Loads a buffer saved with save().
+    static AccumulationBuffer load(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Error opening the checkpoint file " + path + ".");
+        }
+        char magic[sizeof(checkpoint_magic)];
+        int32_t dimensions[2];
+        uint64_t source[2];
+        int32_t share[4];
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char*>(dimensions), sizeof(dimensions));
+        file.read(reinterpret_cast<char*>(source), sizeof(source));
+        file.read(reinterpret_cast<char*>(share), sizeof(share));
+        if (!file || std::string(magic, sizeof(magic)) != std::string(checkpoint_magic, sizeof(checkpoint_magic))) {
+            throw std::runtime_error(path + " is not a checkpoint file.");
+        }
+        AccumulationBuffer buffer(dimensions[0], dimensions[1], AccumulationSource{source[0], source[1]},
+                                  AccumulationShare{share[0], share[1], share[2], share[3]});
+        file.read(reinterpret_cast<char*>(buffer.sample_counts_.data()),
+                  buffer.sample_counts_.size() * sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(buffer.sums_.data()), buffer.sums_.size() * sizeof(float));
+        if (!file) {
+            throw std::runtime_error("The checkpoint file " + path + " is truncated.");
+        }
+        return buffer;
+    }
+
+private:
+    // Identifies checkpoint files, and their version. Version 1 kept the sums of each pixel together,
+    // version 2 had no source, and version 3 no share.
+    static constexpr char checkpoint_magic[8] = {'R', 'T', 'A', 'C', 'C', 'U', 'M', '4'};
+
+    int width_;
+    int height_;
+    AccumulationSource source_;
+    AccumulationShare share_;
+    // The sums of the red, then green, then blue samples of each pixel, each row by row from the bottom.
+    std::vector<float> sums_;
+    std::vector<uint32_t> sample_counts_;
+};
+
+#endif //RAYTRACING_ACCUMULATIONBUFFER_H
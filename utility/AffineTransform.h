@@ -0,0 +1,137 @@
+#ifndef RAYTRACING_AFFINETRANSFORM_H
+#define RAYTRACING_AFFINETRANSFORM_H
+#include "Vec3.h"
+#include <cmath>
+#include <stdexcept>
+
+// Represents an affine transformation as a 3x4 matrix [A | t], mapping a point p to A * p + t
+// and a free vector v to A * v. Transformations are composed by multiplication, where
+// (a * b) applies b first and then a.
+// Rotation angles should be provided in degrees, and follow the right hand rule:
+// they are counter-clockwise when looking down the axis towards the origin.
+struct AffineTransform {
+    // The identity transformation.
+    constexpr AffineTransform() : m_{{1.0, 0.0, 0.0, 0.0},
+                                     {0.0, 1.0, 0.0, 0.0},
+                                     {0.0, 0.0, 1.0, 0.0}} {}
+
+    static AffineTransform translation(const FreeVec3& offset) {
+        AffineTransform transform;
+        transform.m_[0][3] = offset.x();
+        transform.m_[1][3] = offset.y();
+        transform.m_[2][3] = offset.z();
+        return transform;
+    }
+
+    static AffineTransform scaling(value_type x, value_type y, value_type z) {
+        AffineTransform transform;
+        transform.m_[0][0] = x;
+        transform.m_[1][1] = y;
+        transform.m_[2][2] = z;
+        return transform;
+    }
+
+    // y' = cos(theta) * y - sin(theta) * z
+    // z' = sin(theta) * y + cos(theta) * z
+    static AffineTransform rotation_x(value_type angle_in_degrees) {
+        const value_type radians = (M_PI / 180.0) * angle_in_degrees;
+        AffineTransform transform;
+        transform.m_[1][1] = std::cos(radians);
+        transform.m_[1][2] = -std::sin(radians);
+        transform.m_[2][1] = std::sin(radians);
+        transform.m_[2][2] = std::cos(radians);
+        return transform;
+    }
+
+    // x' = cos(theta) * x + sin(theta) * z
+    // z' = -sin(theta) * x + cos(theta) * z
+    static AffineTransform rotation_y(value_type angle_in_degrees) {
+        const value_type radians = (M_PI / 180.0) * angle_in_degrees;
+        AffineTransform transform;
+        transform.m_[0][0] = std::cos(radians);
+        transform.m_[0][2] = std::sin(radians);
+        transform.m_[2][0] = -std::sin(radians);
+        transform.m_[2][2] = std::cos(radians);
+        return transform;
+    }
+
+    // x' = cos(theta) * x - sin(theta) * y
+    // y' = sin(theta) * x + cos(theta) * y
+    static AffineTransform rotation_z(value_type angle_in_degrees) {
+        const value_type radians = (M_PI / 180.0) * angle_in_degrees;
+        AffineTransform transform;
+        transform.m_[0][0] = std::cos(radians);
+        transform.m_[0][1] = -std::sin(radians);
+        transform.m_[1][0] = std::sin(radians);
+        transform.m_[1][1] = std::cos(radians);
+        return transform;
+    }
+
+    inline constexpr value_type operator()(int row, int column) const { return m_[row][column]; }
+
+    // Applies 'other' first, then this transformation.
+    AffineTransform operator*(const AffineTransform& other) const {
+        AffineTransform result;
+        for (int row = 0; row < 3; ++row) {
+            for (int column = 0; column < 4; ++column) {
+                result.m_[row][column] = m_[row][0] * other.m_[0][column]
+                                       + m_[row][1] * other.m_[1][column]
+                                       + m_[row][2] * other.m_[2][column]
+                                       + (column == 3 ? m_[row][3] : 0.0);
+            }
+        }
+        return result;
+    }
+
+    inline BoundVec3 apply(const BoundVec3& p) const {
+        return BoundVec3(m_[0][0] * p.x() + m_[0][1] * p.y() + m_[0][2] * p.z() + m_[0][3],
+                         m_[1][0] * p.x() + m_[1][1] * p.y() + m_[1][2] * p.z() + m_[1][3],
+                         m_[2][0] * p.x() + m_[2][1] * p.y() + m_[2][2] * p.z() + m_[2][3]);
+    }
+
+    inline FreeVec3 apply(const FreeVec3& v) const {
+        return FreeVec3(m_[0][0] * v.x() + m_[0][1] * v.y() + m_[0][2] * v.z(),
+                        m_[1][0] * v.x() + m_[1][1] * v.y() + m_[1][2] * v.z(),
+                        m_[2][0] * v.x() + m_[2][1] * v.y() + m_[2][2] * v.z());
+    }
+
+    // Applies the transpose of A to 'v'. Normals transform by the inverse transpose, so this is
+    // how the inverse of a transformation carries a normal back through it.
+    inline FreeVec3 apply_transpose(const FreeVec3& v) const {
+        return FreeVec3(m_[0][0] * v.x() + m_[1][0] * v.y() + m_[2][0] * v.z(),
+                        m_[0][1] * v.x() + m_[1][1] * v.y() + m_[2][1] * v.z(),
+                        m_[0][2] * v.x() + m_[1][2] * v.y() + m_[2][2] * v.z());
+    }
+
+    // The inverse [A^-1 | -A^-1 * t], with A^-1 computed from the cofactors of A.
+    AffineTransform inverse() const {
+        const value_type c00 = m_[1][1] * m_[2][2] - m_[1][2] * m_[2][1];
+        const value_type c01 = m_[1][2] * m_[2][0] - m_[1][0] * m_[2][2];
+        const value_type c02 = m_[1][0] * m_[2][1] - m_[1][1] * m_[2][0];
+        const value_type determinant = m_[0][0] * c00 + m_[0][1] * c01 + m_[0][2] * c02;
+        if (determinant == 0.0) {
+            throw std::invalid_argument("AffineTransform is singular and cannot be inverted.");
+        }
+        const value_type inverse_determinant = 1.0 / determinant;
+        AffineTransform result;
+        result.m_[0][0] = c00 * inverse_determinant;
+        result.m_[1][0] = c01 * inverse_determinant;
+        result.m_[2][0] = c02 * inverse_determinant;
+        result.m_[0][1] = (m_[0][2] * m_[2][1] - m_[0][1] * m_[2][2]) * inverse_determinant;
+        result.m_[1][1] = (m_[0][0] * m_[2][2] - m_[0][2] * m_[2][0]) * inverse_determinant;
+        result.m_[2][1] = (m_[0][1] * m_[2][0] - m_[0][0] * m_[2][1]) * inverse_determinant;
+        result.m_[0][2] = (m_[0][1] * m_[1][2] - m_[0][2] * m_[1][1]) * inverse_determinant;
+        result.m_[1][2] = (m_[0][2] * m_[1][0] - m_[0][0] * m_[1][2]) * inverse_determinant;
+        result.m_[2][2] = (m_[0][0] * m_[1][1] - m_[0][1] * m_[1][0]) * inverse_determinant;
+        const FreeVec3 translation = result.apply(FreeVec3(m_[0][3], m_[1][3], m_[2][3]));
+        result.m_[0][3] = -translation.x();
+        result.m_[1][3] = -translation.y();
+        result.m_[2][3] = -translation.z();
+        return result;
+    }
+
+private:
+    value_type m_[3][4];
+};
+
+#endif //RAYTRACING_AFFINETRANSFORM_H
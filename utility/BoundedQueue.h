@@ -0,0 +1,63 @@
+#ifndef RAYTRACING_BOUNDEDQUEUE_H
+#define RAYTRACING_BOUNDEDQUEUE_H
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+// A first-in first-out queue between threads holding at most a fixed number of items. Producers
+// wait while it is full, so that a slow consumer holds them back rather than letting the queue grow
+// without bound, and consumers wait while it is empty, until it is closed.
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity) : capacity_{capacity} {
+        if (capacity == 0) {
+            throw std::invalid_argument("A BoundedQueue must hold at least one item.");
+        }
+    }
+
+    // Adds 'item' at the back, once there is room. Returns false, dropping the item, if the queue is closed.
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this]() { return closed_ || items_.size() < capacity_; });
+        if (closed_) return false;
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Takes the item at the front into 'item', once there is one. Returns false if the queue is closed
+    // and empty.
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    // Stops the queue accepting items. Items already in it can still be taken.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+private:
+    const std::size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    bool closed_ = false;
+};
+
+#endif //RAYTRACING_BOUNDEDQUEUE_H
@@ -3,6 +3,11 @@
 #include "Vec3.h"
 #include <cmath>
 #include "util.h"
+#include "RayPacket.h"
+#include "Sampler.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
 
 // Encapsulates a positionable camera.
 // Note, while this camera will use radians for calculations,
@@ -36,11 +41,12 @@ public:
         vertical_ = FreeVec3(v_ * 2 * half_height * focus_distance);
     }
 
-    // Gets the current ray from the camera point of view.
-    Ray getRay(value_type s, value_type t) const {
-        const FreeVec3 rd = random_value_in_unit_disk() * lens_radius_;
+    // Gets the current ray from the camera point of view. The point on the lens and the time
+    // are drawn from 'sampler'.
+    Ray getRay(value_type s, value_type t, Sampler& sampler) const {
+        const FreeVec3 rd = random_value_in_unit_disk(sampler) * lens_radius_;
         const FreeVec3 offset = u_ * rd.x() + v_ * rd.y();
-        const value_type time = time0_ + random_value() * (time1_ - time0_);
+        const value_type time = time0_ + sampler.next_value() * (time1_ - time0_);
         return Ray(origin_ + offset,
                 UnitVec3(lower_left_corner_
                 + (horizontal_ * s)
@@ -61,16 +67,77 @@ public:
     // The maximum recursion depth determines how many ray bounces are allowed.
     // Note that NVIDIA highly recommends reducing the maximum recursion depth to
     // improve speed. Source: https://devblogs.nvidia.com/rtx-best-practices/
-    static void antialiasing(Color3& current_color, const Camera* camera, const HittableWorld* world,
+    // If 'packet_size' is greater than 1, the primary rays are traced in packets of that
+    // many samples (at most max_packet_size); see antialiasing_packets.
+    // Each sample draws its random numbers from its own Sampler, given by 'seed', the pixel, and the
+    // sample's number, so the color depends only on these and not on which thread computes it.
+    // Paths may be ended by Russian roulette after 'russian_roulette_depth' bounces; see shade.
+    static void antialiasing(Color3& current_color, const Camera* camera, const Hittable* world,
                       int num_samples, int x_pixels, int y_pixels, int i, int j,
-                      int maximum_recursion_depth) {
+                      int maximum_recursion_depth, int packet_size = 1, uint64_t seed = 0,
+                      int russian_roulette_depth = default_russian_roulette_depth) {
+        if (packet_size > 1) {
+            antialiasing_packets(current_color, camera, world, num_samples, x_pixels, y_pixels, i, j,
+                                 maximum_recursion_depth, packet_size, seed, russian_roulette_depth);
+            return;
+        }
         for (int current_run = 0; current_run < num_samples; ++current_run) {
-            const value_type u = value_type(i + random_value()) / value_type(x_pixels);
-            const value_type v = value_type(j + random_value()) / value_type(y_pixels);
-            const Ray ray = camera->getRay(u, v);
-            int current_recursion_depth = 0;
             current_color = remove_NaN(current_color);
-            current_color += ray_color(ray, world,  maximum_recursion_depth, current_recursion_depth);
+            current_color += sample_pixel(camera, world, x_pixels, y_pixels, i, j, current_run,
+                                          maximum_recursion_depth, seed, russian_roulette_depth);
+        }
+        current_color /= value_type(num_samples); // Take average sample.
+    }
+
+    // Computes sample number 'sample' of pixel (i, j), as antialiasing does: the color seen along a ray
+    // through a random point of the pixel. Samples can thus be taken a few at a time, e.g. by progressive
+    // rendering, and still be the same as those of antialiasing.
+    static Color3 sample_pixel(const Camera* camera, const Hittable* world, int x_pixels, int y_pixels,
+                               int i, int j, uint64_t sample, int maximum_recursion_depth, uint64_t seed = 0,
+                               int russian_roulette_depth = default_russian_roulette_depth) {
+        Sampler sampler(seed, uint64_t(j) * x_pixels + i, sample);
+        const value_type u = value_type(i + sampler.next_value()) / value_type(x_pixels);
+        const value_type v = value_type(j + sampler.next_value()) / value_type(y_pixels);
+        const Ray ray = camera->getRay(u, v, sampler);
+        int current_recursion_depth = 0;
+        return ray_color(ray, world,  maximum_recursion_depth, current_recursion_depth, sampler,
+                         russian_roulette_depth);
+    }
+
+    // Anti-aliasing as above, where the samples of the pixel are generated 'packet_size' at a time
+    // and their primary rays are traced together through the world with Hittable::hit_packet.
+    // Since all the rays pass through the same pixel, they follow nearly the same path through
+    // the acceleration structure. Each ray is then shaded, and its bounces traced, on its own.
+    static void antialiasing_packets(Color3& current_color, const Camera* camera, const Hittable* world,
+                                     int num_samples, int x_pixels, int y_pixels, int i, int j,
+                                     int maximum_recursion_depth, int packet_size, uint64_t seed = 0,
+                                     int russian_roulette_depth = default_russian_roulette_depth) {
+        packet_size = packet_size < max_packet_size ? packet_size : max_packet_size;
+        const uint64_t pixel = uint64_t(j) * x_pixels + i;
+        for (int first_run = 0; first_run < num_samples; first_run += packet_size) {
+            RayPacket packet;
+            // The samplers of the rays in the packet, which go on to shade their hits.
+            Sampler samplers[max_packet_size];
+            for (int current_run = first_run; current_run < num_samples && packet.size < packet_size; ++current_run) {
+                Sampler& sampler = samplers[packet.size];
+                sampler = Sampler(seed, pixel, current_run);
+                const value_type u = value_type(i + sampler.next_value()) / value_type(x_pixels);
+                const value_type v = value_type(j + sampler.next_value()) / value_type(y_pixels);
+                packet.add(camera->getRay(u, v, sampler));
+            }
+            value_type t_max[max_packet_size];
+            std::fill(t_max, t_max + packet.size, std::numeric_limits<value_type>::max());
+            HitRecord records[max_packet_size];
+            const int hits = world->hit_packet(packet, packet.all(), /*t_min=*/value_type(0.001), t_max, records);
+            for (int k = 0; k < packet.size; ++k) {
+                current_color = remove_NaN(current_color);
+                if (hits >> k & 1) {
+                    int current_recursion_depth = 0;
+                    current_color += shade(packet.rays[k], records[k], world,
+                                           maximum_recursion_depth, current_recursion_depth, samplers[k],
+                                           russian_roulette_depth);
+                }
+            }
         }
         current_color /= value_type(num_samples); // Take average sample.
     }
@@ -0,0 +1,51 @@
+#ifndef RAYTRACING_FRAMEBUFFER_H
+#define RAYTRACING_FRAMEBUFFER_H
+#include "Vec3.h"
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+// An image being rendered, holding the (linear, undampened) color of each pixel in single precision.
+// Pixel (i, j) is column i of row j, counted from the bottom left corner as with Camera::antialiasing.
+// Distinct pixels may be written by different threads at the same time.
+// The red, green, and blue values are each kept in a plane of their own, so that passes over the whole
+// image (see PostProcessor) run over contiguous arrays of floats.
+class Framebuffer {
+public:
+    Framebuffer(int width, int height) : width_{width}, height_{height} {
+        if (width <= 0 || height <= 0) {
+            throw std::invalid_argument("Framebuffer dimensions must be positive.");
+        }
+        planes_.resize(3 * pixel_count());
+    }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    std::size_t pixel_count() const { return std::size_t(width_) * height_; }
+
+    Color3 pixel(int i, int j) const {
+        const std::size_t index = std::size_t(j) * width_ + i;
+        const std::size_t size = pixel_count();
+        return Color3(planes_[index], planes_[size + index], planes_[2 * size + index]);
+    }
+
+    void set_pixel(int i, int j, const Color3& color) {
+        const std::size_t index = std::size_t(j) * width_ + i;
+        const std::size_t size = pixel_count();
+        planes_[index] = float(color.r());
+        planes_[size + index] = float(color.g());
+        planes_[2 * size + index] = float(color.b());
+    }
+
+    // The values of 'channel' (0 for red, 1 for green, 2 for blue) of every pixel, row by row from the bottom.
+    const float* plane(int channel) const { return planes_.data() + channel * pixel_count(); }
+    float* plane(int channel) { return planes_.data() + channel * pixel_count(); }
+
+private:
+    int width_;
+    int height_;
+    // The red, green, and blue planes, one after the other.
+    std::vector<float> planes_;
+};
+
+#endif //RAYTRACING_FRAMEBUFFER_H
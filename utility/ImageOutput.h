@@ -0,0 +1,502 @@
+#ifndef RAYTRACING_IMAGEOUTPUT_H
+#define RAYTRACING_IMAGEOUTPUT_H
+#include "BoundedQueue.h"
+#include "Framebuffer.h"
+#include "PostProcess.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// The formats an image can be written in.
+enum IMAGE_FORMAT {
+    // Plain PPM (P3): gamma-encoded colors as decimal text.
+    PPM_PLAIN,
+    // Binary PPM (P6): gamma-encoded colors as bytes, or as big-endian 16-bit values if max_color exceeds 255.
+    PPM_BINARY,
+    // Portable float map (PF): the linear colors as 32-bit floats, rows from the bottom, keeping the full range.
+    PFM,
+    // Tiled float: the linear colors as 32-bit floats in tiles, each written as it is finished; see append_tile.
+    TILED_FLOAT
+};
+
+// How an image is written.
+struct ImageSettings {
+    IMAGE_FORMAT format = PPM_BINARY;
+    // How the colors of PPM images are post-processed. Float formats keep the colors as rendered.
+    PostProcessSettings post_process;
+};
+
+// The format named 'name': p3, p6, pfm, or tiled.
+inline IMAGE_FORMAT image_format(const std::string& name) {
+    if (name == "p3") return PPM_PLAIN;
+    if (name == "p6") return PPM_BINARY;
+    if (name == "pfm") return PFM;
+    if (name == "tiled") return TILED_FLOAT;
+    throw std::invalid_argument("Unknown image format '" + name + "'; expected p3, p6, pfm, or tiled.");
+}
+
+// Sets the setting named 'name' (format, gamma, exposure, tone_map, or max_color) to 'value', e.g. from
+// command line options. Returns false if there is no such setting, and throws if 'value' is not valid for it.
+inline bool set_image_setting(ImageSettings& settings, const std::string& name, const std::string& value) {
+    if (name == "format") {
+        settings.format = image_format(value);
+        return true;
+    }
+    if (name == "tone_map") {
+        settings.post_process.tone_mapping = tone_mapping(value);
+        return true;
+    }
+    if (name != "gamma" && name != "exposure" && name != "max_color") return false;
+    std::size_t length = 0;
+    value_type number = 0.0;
+    try {
+        number = std::stod(value, &length);
+    } catch (const std::exception&) {
+    }
+    if (length == 0 || length != value.size()) {
+        throw std::invalid_argument("Expected a number for " + name + " rather than '" + value + "'.");
+    }
+    if (name == "exposure") {
+        settings.post_process.exposure = number;
+    } else if (name == "gamma" && number > 0.0) {
+        settings.post_process.gamma = number;
+    } else if (name == "max_color" && number >= 1.0 && number <= 65535.0) {
+        settings.post_process.max_color = int(number);
+    } else {
+        throw std::invalid_argument("The " + name + " '" + value + "' is out of range.");
+    }
+    return true;
+}
+
+// The command line options read by read_image_option.
+constexpr const char* image_options_usage =
+        "[--format p3|p6|pfm|tiled] [--gamma GAMMA] [--exposure STOPS] [--tone-map clamp|reinhard|aces]";
+
+// If argv[k] is one of the options of image_options_usage, i.e. "--" followed by a setting of
+// set_image_setting (with '-' for '_'), sets it to argv[k + 1], moves 'k' past both, and returns true.
+inline bool read_image_option(int argc, char* argv[], int& k, ImageSettings& settings) {
+    const std::string argument = argv[k];
+    if (k + 1 >= argc || argument.compare(0, 2, "--") != 0) return false;
+    std::string name = argument.substr(2);
+    std::replace(name.begin(), name.end(), '-', '_');
+    if (!set_image_setting(settings, name, argv[k + 1])) return false;
+    k += 2;
+    return true;
+}
+
+// The usual file name extension of images in 'format'.
+inline std::string image_extension(IMAGE_FORMAT format) {
+    switch (format) {
+        case PFM: return ".pfm";
+        case TILED_FLOAT: return ".rtt";
+        default: return ".ppm";
+    }
+}
+
+// Whether the rows of images in 'format' are written from the bottom up rather than from the top down.
+// Tiled images are written by tile instead.
+inline bool is_written_bottom_up(IMAGE_FORMAT format) { return format == PFM; }
+
+// Identifies tiled float images, and their version.
+constexpr char tiled_image_magic[8] = {'R', 'T', 'T', 'I', 'L', 'E', 'D', '1'};
+
+// The header of an image of 'width' x 'height' pixels.
+inline std::string image_header(int width, int height, const ImageSettings& settings) {
+    const std::string dimensions = std::to_string(width) + " " + std::to_string(height) + "\n";
+    switch (settings.format) {
+        case PPM_PLAIN: return "P3\n" + dimensions + std::to_string(settings.post_process.max_color) + "\n";
+        case PPM_BINARY: return "P6\n" + dimensions + std::to_string(settings.post_process.max_color) + "\n";
+        case PFM: {
+            // A negative scale marks little-endian floats.
+            const uint16_t one = 1;
+            const bool is_little_endian = *reinterpret_cast<const unsigned char*>(&one) == 1;
+            return "PF\n" + dimensions + (is_little_endian ? "-1.0\n" : "1.0\n");
+        }
+        case TILED_FLOAT: {
+            // The magic, then the width and height as 32-bit integers, in the byte order of the machine.
+            std::string header(tiled_image_magic, sizeof(tiled_image_magic));
+            const int32_t size[2] = {width, height};
+            header.append(reinterpret_cast<const char*>(size), sizeof(size));
+            return header;
+        }
+    }
+    throw std::invalid_argument("Unknown image format.");
+}
+
+// Stores 'width' pixels, given their post-processed 'red', 'green', and 'blue' values, at 'bytes' as pixels of a
+// binary PPM image: 3 bytes each, or 6 if 'is_wide' (for a max_color above 255).
+inline void store_ppm_binary_pixels(const uint16_t* red, const uint16_t* green, const uint16_t* blue, int width,
+                                    bool is_wide, unsigned char* bytes) {
+    for (int i = 0; i < width; ++i) {
+        for (const uint16_t value : {red[i], green[i], blue[i]}) {
+            if (is_wide) *bytes++ = (unsigned char) (value >> 8);
+            *bytes++ = (unsigned char) value;
+        }
+    }
+}
+
+// Appends a row of 'width' pixels, left to right, to 'data' as pixels of an image in the settings' PPM
+// format, given their post-processed 'red', 'green', and 'blue' values.
+inline void append_ppm_row(const uint16_t* red, const uint16_t* green, const uint16_t* blue, int width,
+                           const ImageSettings& settings, std::string& data) {
+    if (settings.format == PPM_PLAIN) {
+        // Three values of at most 5 characters, each followed by a space or a newline. One pixel per line.
+        char pixel[18];
+        for (int i = 0; i < width; ++i) {
+            const uint16_t values[3] = {red[i], green[i], blue[i]};
+            char* end = pixel;
+            for (int channel = 0; channel < 3; ++channel) {
+                end = std::to_chars(end, pixel + sizeof(pixel), values[channel]).ptr;
+                *end++ = channel < 2 ? ' ' : '\n';
+            }
+            data.append(pixel, end);
+        }
+    } else if (settings.format == PPM_BINARY) {
+        const bool is_wide = settings.post_process.max_color > 255;
+        const std::size_t start = data.size();
+        data.resize(start + std::size_t(width) * 3 * (is_wide ? 2 : 1));
+        store_ppm_binary_pixels(red, green, blue, width, is_wide,
+                                reinterpret_cast<unsigned char*>(&data[start]));
+    } else {
+        throw std::invalid_argument("Only PPM images are written from post-processed values.");
+    }
+}
+
+// Appends row 'j' of 'framebuffer' to 'data' as pixels of an image in the settings' PPM or PFM format,
+// left to right, post-processing them first for PPM.
+inline void append_image_row(const Framebuffer& framebuffer, int j, const ImageSettings& settings, std::string& data) {
+    const int width = framebuffer.width();
+    const std::size_t row_start = std::size_t(j) * width;
+    if (settings.format == PFM) {
+        const std::size_t start = data.size();
+        data.resize(start + std::size_t(width) * 3 * sizeof(float));
+        char* bytes = &data[start];
+        for (int i = 0; i < width; ++i) {
+            for (int channel = 0; channel < 3; ++channel) {
+                std::memcpy(bytes, framebuffer.plane(channel) + row_start + i, sizeof(float));
+                bytes += sizeof(float);
+            }
+        }
+    } else if (settings.format == PPM_PLAIN || settings.format == PPM_BINARY) {
+        std::vector<uint16_t> encoded(3 * std::size_t(width));
+        for (int channel = 0; channel < 3; ++channel) {
+            encode_values(framebuffer.plane(channel) + row_start, width, settings.post_process,
+                          encoded.data() + channel * width);
+        }
+        append_ppm_row(encoded.data(), encoded.data() + width, encoded.data() + 2 * width, width, settings, data);
+    } else {
+        throw std::invalid_argument("Tiled images are written by tile rather than by row.");
+    }
+}
+
+// Appends pixels [i_begin, i_end) x [j_begin, j_end) of 'framebuffer' to 'data' as a tile of a tiled float
+// image. A tiled image is its header followed by any number of tiles, in any order, so that each tile can
+// be written as soon as it is finished. Each tile is its bounds i_begin, i_end, j_begin, j_end as 32-bit
+// integers, followed by the linear red, green, and blue values of its pixels as 32-bit floats, row by row
+// from the bottom, all in the byte order of the machine.
+inline void append_tile(const Framebuffer& framebuffer, int i_begin, int i_end, int j_begin, int j_end,
+                        std::string& data) {
+    const int32_t bounds[4] = {i_begin, i_end, j_begin, j_end};
+    data.append(reinterpret_cast<const char*>(bounds), sizeof(bounds));
+    const std::size_t start = data.size();
+    data.resize(start + std::size_t(i_end - i_begin) * (j_end - j_begin) * 3 * sizeof(float));
+    char* bytes = &data[start];
+    for (int j = j_begin; j < j_end; ++j) {
+        const std::size_t row_start = std::size_t(j) * framebuffer.width();
+        for (int i = i_begin; i < i_end; ++i) {
+            for (int channel = 0; channel < 3; ++channel) {
+                std::memcpy(bytes, framebuffer.plane(channel) + row_start + i, sizeof(float));
+                bytes += sizeof(float);
+            }
+        }
+    }
+}
+
+// Writes 'framebuffer' to the file 'path' as an image with the given settings. Images which need
+// post-processing are processed by 'post_processor', whose threads are thus reused across images.
+inline void write_image(const std::string& path, const Framebuffer& framebuffer, PostProcessor& post_processor,
+                        const ImageSettings& settings = ImageSettings()) {
+    std::ofstream file;
+    file.open(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("\nError opening the file.");
+    }
+    std::string data = image_header(framebuffer.width(), framebuffer.height(), settings);
+    if (settings.format == TILED_FLOAT) {
+        const int tile_size = 64;
+        for (int j_begin = 0; j_begin < framebuffer.height(); j_begin += tile_size) {
+            for (int i_begin = 0; i_begin < framebuffer.width(); i_begin += tile_size) {
+                append_tile(framebuffer, i_begin, std::min(framebuffer.width(), i_begin + tile_size),
+                            j_begin, std::min(framebuffer.height(), j_begin + tile_size), data);
+                file.write(data.data(), data.size());
+                data.clear();
+            }
+        }
+    } else if (settings.format == PFM) {
+        for (int j = 0; j < framebuffer.height(); ++j) {
+            append_image_row(framebuffer, j, settings, data);
+            file.write(data.data(), data.size());
+            data.clear();
+        }
+    } else {
+        // Post-process the whole image at once, on the threads of 'post_processor', then write it top to bottom.
+        const DisplayImage image = post_processor.process(framebuffer, settings.post_process);
+        for (int j = framebuffer.height() - 1; j >= 0; --j) {
+            const std::size_t row_start = std::size_t(j) * image.width();
+            append_ppm_row(image.plane(0) + row_start, image.plane(1) + row_start, image.plane(2) + row_start,
+                           image.width(), settings, data);
+            file.write(data.data(), data.size());
+            data.clear();
+        }
+    }
+    file.close();
+    if (!file) {
+        throw std::runtime_error("\nError writing the file.");
+    }
+}
+
+// Reads a tiled float image written by write_image or AsyncImageWriter. Pixels of no tile are black.
+inline Framebuffer read_tiled_image(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Error opening the image file " + path + ".");
+    }
+    char magic[sizeof(tiled_image_magic)];
+    int32_t size[2];
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(size), sizeof(size));
+    if (!file || std::string(magic, sizeof(magic)) != std::string(tiled_image_magic, sizeof(tiled_image_magic))) {
+        throw std::runtime_error(path + " is not a tiled float image.");
+    }
+    Framebuffer framebuffer(size[0], size[1]);
+    int32_t bounds[4];
+    std::vector<float> values;
+    while (file.read(reinterpret_cast<char*>(bounds), sizeof(bounds))) {
+        const int i_begin = bounds[0], i_end = bounds[1], j_begin = bounds[2], j_end = bounds[3];
+        if (i_begin < 0 || i_begin > i_end || i_end > size[0] || j_begin < 0 || j_begin > j_end || j_end > size[1]) {
+            throw std::runtime_error(path + " has a tile outside the image.");
+        }
+        values.resize(std::size_t(i_end - i_begin) * (j_end - j_begin) * 3);
+        if (!file.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(float))) {
+            throw std::runtime_error("The image file " + path + " is truncated.");
+        }
+        const float* value = values.data();
+        for (int j = j_begin; j < j_end; ++j) {
+            for (int i = i_begin; i < i_end; ++i, value += 3) {
+                framebuffer.set_pixel(i, j, Color3(value[0], value[1], value[2]));
+            }
+        }
+    }
+    return framebuffer;
+}
+
+// Writes an image, as write_image does, while it is being rendered. Rendering threads report each tile
+// of 'framebuffer' as it is finished with tile_finished, which only queues it. A writer thread of its own
+// encodes and writes each tile of a tiled image, or else each row in the order of the format, as soon
+// as it is finished. The rendering threads thus never wait on encoding or on the file, unless the writer
+// falls 'queue_capacity' tiles behind.
+class AsyncImageWriter {
+public:
+    AsyncImageWriter(const std::string& path, const Framebuffer& framebuffer,
+                     const ImageSettings& settings = ImageSettings(), std::size_t queue_capacity = 1024)
+            : framebuffer_{framebuffer}, settings_{settings}, finished_tiles_{queue_capacity},
+              finished_pixels_(framebuffer.height(), 0) {
+        file_.open(path, std::ios::binary);
+        if (!file_) {
+            throw std::runtime_error("\nError opening the file.");
+        }
+        writer_ = std::thread([this]() { write(); });
+    }
+
+    AsyncImageWriter(const AsyncImageWriter&) = delete;
+    AsyncImageWriter& operator=(const AsyncImageWriter&) = delete;
+
+    ~AsyncImageWriter() {
+        if (writer_.joinable()) {
+            finished_tiles_.close();
+            writer_.join();
+        }
+    }
+
+    // Reports that pixels [i_begin, i_end) x [j_begin, j_end) of the framebuffer are finished, and will not
+    // change again. May be called from any thread.
+    void tile_finished(int i_begin, int i_end, int j_begin, int j_end) {
+        finished_tiles_.push(Tile{i_begin, i_end, j_begin, j_end});
+    }
+
+    // Waits for the writer to write every row, once all the tiles have been reported.
+    // Rethrows the first error of the writer, or throws if some pixels were never reported.
+    void finish() {
+        finished_tiles_.close();
+        writer_.join();
+        if (error_) std::rethrow_exception(error_);
+        if (written_rows_ < framebuffer_.height()) {
+            throw std::runtime_error("\nThe image was written before all of its pixels were finished.");
+        }
+    }
+
+private:
+    struct Tile {
+        int i_begin, i_end, j_begin, j_end;
+    };
+
+    // Run by the writer thread: counts the finished pixels of each row, and writes every tile of a tiled image,
+    // or else every row that is complete and next in the order of the format.
+    void write() {
+        try {
+            std::string data = image_header(framebuffer_.width(), framebuffer_.height(), settings_);
+            file_.write(data.data(), data.size());
+            data.clear();
+            const bool is_tiled = settings_.format == TILED_FLOAT;
+            const bool bottom_up = is_written_bottom_up(settings_.format);
+            Tile tile;
+            while (finished_tiles_.pop(tile)) {
+                for (int j = tile.j_begin; j < tile.j_end; ++j) {
+                    finished_pixels_[j] += tile.i_end - tile.i_begin;
+                }
+                if (is_tiled) {
+                    append_tile(framebuffer_, tile.i_begin, tile.i_end, tile.j_begin, tile.j_end, data);
+                }
+                while (written_rows_ < framebuffer_.height()) {
+                    const int j = bottom_up ? written_rows_ : framebuffer_.height() - 1 - written_rows_;
+                    if (finished_pixels_[j] != framebuffer_.width()) break;
+                    if (!is_tiled) append_image_row(framebuffer_, j, settings_, data);
+                    ++written_rows_;
+                }
+                if (!data.empty()) {
+                    file_.write(data.data(), data.size());
+                    data.clear();
+                }
+            }
+            file_.close();
+            if (!file_) {
+                throw std::runtime_error("\nError writing the file.");
+            }
+        } catch (...) {
+            error_ = std::current_exception();
+            // Let the rendering threads go on; their tiles are no longer needed.
+            finished_tiles_.close();
+        }
+    }
+
+    const Framebuffer& framebuffer_;
+    const ImageSettings settings_;
+    std::ofstream file_;
+    BoundedQueue<Tile> finished_tiles_;
+    // The number of finished pixels of each row, and the number of rows written (or, for a tiled image,
+    // complete), in the order of the format. Only the writer thread uses these until it is joined.
+    std::vector<int> finished_pixels_;
+    int written_rows_ = 0;
+    std::exception_ptr error_;
+    std::thread writer_;
+};
+
+// Writes a binary PPM or PFM image straight into its file while it is being rendered, with no writer thread
+// and no copy of the image besides 'framebuffer'. The file is created at its full size and mapped into memory.
+// Since every pixel of these formats takes the same number of bytes, each pixel's place in the file follows
+// from the header's size. Rendering threads call tile_finished for each tile of 'framebuffer' once it is
+// finished, which encodes it into its place in the mapped file. Pixels not yet finished are black on disk,
+// so a partially rendered image can be looked at while the rest is rendered.
+class MappedImageWriter {
+public:
+    MappedImageWriter(const std::string& path, const Framebuffer& framebuffer,
+                      const ImageSettings& settings = ImageSettings())
+            : framebuffer_{framebuffer}, settings_{settings} {
+        if (settings.format != PPM_BINARY && settings.format != PFM) {
+            throw std::invalid_argument("Only binary PPM and PFM images can be written into a mapped file.");
+        }
+        const std::string header = image_header(framebuffer.width(), framebuffer.height(), settings);
+        header_size_ = header.size();
+        pixel_size_ = settings.format == PFM ? 3 * sizeof(float) : settings.post_process.max_color > 255 ? 6 : 3;
+        size_ = header_size_ + framebuffer.pixel_count() * pixel_size_;
+        descriptor_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (descriptor_ < 0) {
+            throw std::runtime_error("\nError opening the file.");
+        }
+        // The file reads as zeros, i.e. black, until each pixel is written.
+        void* mapping = MAP_FAILED;
+        if (ftruncate(descriptor_, off_t(size_)) == 0) {
+            mapping = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor_, 0);
+        }
+        if (mapping == MAP_FAILED) {
+            close(descriptor_);
+            throw std::runtime_error("\nError mapping the file.");
+        }
+        data_ = static_cast<unsigned char*>(mapping);
+        std::memcpy(data_, header.data(), header_size_);
+    }
+
+    MappedImageWriter(const MappedImageWriter&) = delete;
+    MappedImageWriter& operator=(const MappedImageWriter&) = delete;
+
+    ~MappedImageWriter() { unmap(); }
+
+    // Encodes pixels [i_begin, i_end) x [j_begin, j_end) of the framebuffer into the file. May be called from
+    // any thread, for distinct pixels.
+    void tile_finished(int i_begin, int i_end, int j_begin, int j_end) {
+        const int count = i_end - i_begin;
+        const bool is_wide = pixel_size_ == 6;
+        std::vector<uint16_t> encoded(settings_.format == PFM ? 0 : 3 * std::size_t(count));
+        for (int j = j_begin; j < j_end; ++j) {
+            const std::size_t row_start = std::size_t(j) * framebuffer_.width();
+            const int file_row = is_written_bottom_up(settings_.format) ? j : framebuffer_.height() - 1 - j;
+            unsigned char* bytes = data_ + header_size_
+                                   + (std::size_t(file_row) * framebuffer_.width() + i_begin) * pixel_size_;
+            if (settings_.format == PFM) {
+                for (int i = i_begin; i < i_end; ++i) {
+                    for (int channel = 0; channel < 3; ++channel) {
+                        std::memcpy(bytes, framebuffer_.plane(channel) + row_start + i, sizeof(float));
+                        bytes += sizeof(float);
+                    }
+                }
+                continue;
+            }
+            for (int channel = 0; channel < 3; ++channel) {
+                encode_values(framebuffer_.plane(channel) + row_start + i_begin, count, settings_.post_process,
+                              encoded.data() + channel * count);
+            }
+            store_ppm_binary_pixels(encoded.data(), encoded.data() + count, encoded.data() + 2 * count, count,
+                                    is_wide, bytes);
+        }
+    }
+
+    // Unmaps and closes the file, once every tile has been reported. The operating system writes the mapped
+    // pages back to the file in its own time; throws if that cannot be arranged.
+    void finish() {
+        if (!unmap()) {
+            throw std::runtime_error("\nError writing the file.");
+        }
+    }
+
+private:
+    // Returns false if unmapping or closing the file failed.
+    bool unmap() {
+        if (!data_) return true;
+        const bool unmapped = munmap(data_, size_) == 0;
+        data_ = nullptr;
+        return (close(descriptor_) == 0) && unmapped;
+    }
+
+    const Framebuffer& framebuffer_;
+    const ImageSettings settings_;
+    std::size_t header_size_;
+    // The bytes of each pixel in the file, and of the whole file.
+    std::size_t pixel_size_;
+    std::size_t size_;
+    int descriptor_ = -1;
+    unsigned char* data_ = nullptr;
+};
+
+#endif //RAYTRACING_IMAGEOUTPUT_H
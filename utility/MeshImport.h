@@ -0,0 +1,760 @@
+#ifndef RAYTRACING_MESHIMPORT_H
+#define RAYTRACING_MESHIMPORT_H
+#include "ThreadPool.h"
+#include "Vec3.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The flat arrays of an imported mesh, as TriangleMesh takes them.
+struct MeshData {
+    std::vector<BoundVec3> positions;
+    // Either empty, or one shading normal per vertex.
+    std::vector<FreeVec3> normals;
+    // Either empty, or one (u, v) texture coordinate pair per vertex.
+    std::vector<value_type> uvs;
+    // Three vertex indices per triangle.
+    std::vector<int> indices;
+};
+
+// A file mapped read-only into memory for the life of the object, so that it is read straight from the
+// page cache rather than copied into a buffer first.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        descriptor_ = open(path.c_str(), O_RDONLY);
+        if (descriptor_ < 0) {
+            throw std::runtime_error("\nError opening the file " + path + ".");
+        }
+        struct stat status{};
+        if (fstat(descriptor_, &status) != 0) {
+            close(descriptor_);
+            throw std::runtime_error("\nError reading the file " + path + ".");
+        }
+        size_ = std::size_t(status.st_size);
+        if (size_ == 0) return;
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, descriptor_, 0);
+        if (mapping == MAP_FAILED) {
+            close(descriptor_);
+            throw std::runtime_error("\nError mapping the file " + path + ".");
+        }
+        // Each part of the file is read from start to end, so read ahead generously.
+        madvise(mapping, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(mapping);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+        close(descriptor_);
+    }
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    int descriptor_ = -1;
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// The types of the values in a PLY file.
+enum PLY_TYPE {
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+};
+
+// Imports meshes from Wavefront OBJ and binary PLY files. The file is mapped into memory and split into
+// parts that are parsed in parallel on a pool of threads, so loading runs at close to the speed at which
+// the file can be read.
+class MeshImporter {
+public:
+    // Starts 'thread_count' threads, or one per hardware thread if 'thread_count' is not positive.
+    explicit MeshImporter(int thread_count = 0) : pool_{thread_count} {}
+
+    // Loads the mesh file 'path': a PLY file if it starts with a PLY header, and an OBJ file otherwise.
+    // Throws std::invalid_argument, naming the file, if it is not a valid mesh.
+    MeshData load(const std::string& path) {
+        const MappedFile file(path);
+        try {
+            if (file.size() >= 4 && std::memcmp(file.data(), "ply", 3) == 0
+                && (file.data()[3] == '\n' || file.data()[3] == '\r')) {
+                return read_ply(file.data(), file.size());
+            }
+            return read_obj(file.data(), file.size());
+        } catch (const std::invalid_argument& error) {
+            throw std::invalid_argument(path + ": " + error.what());
+        }
+    }
+
+    // Reads a Wavefront OBJ file of 'size' bytes. Only the geometry is read: positions (v), texture
+    // coordinates (vt), normals (vn), and faces (f), which are split into fans of triangles. Other
+    // statements, such as groups and materials, are ignored.
+    // A face corner refers to a position, and optionally texture coordinates and a normal, each by its own
+    // index, whereas the mesh has one index per vertex. Corners with the same indices therefore become a
+    // single vertex. Texture coordinates and normals are kept only if every corner has them.
+    MeshData read_obj(const char* data, std::size_t size) {
+        // Split the file into runs of whole lines, to be parsed in parallel.
+        std::vector<ObjChunk> chunks;
+        const char* const end = data + size;
+        for (const char* begin = data; begin < end; ) {
+            const char* chunk_end = begin + std::min(obj_chunk_size, std::size_t(end - begin));
+            if (chunk_end < end) {
+                const void* newline = std::memchr(chunk_end, '\n', end - chunk_end);
+                chunk_end = newline ? static_cast<const char*>(newline) + 1 : end;
+            }
+            chunks.emplace_back();
+            chunks.back().begin = begin;
+            chunks.back().end = chunk_end;
+            begin = chunk_end;
+        }
+        run_for_each(chunks.size(), [&](std::size_t c) { parse_obj_chunk(chunks[c]); });
+
+        // Where each chunk's vertex data and corners start in the whole file.
+        const std::size_t chunk_count = chunks.size();
+        std::vector<std::size_t> position_offsets(chunk_count + 1, 0), uv_offsets(chunk_count + 1, 0),
+                normal_offsets(chunk_count + 1, 0), corner_offsets(chunk_count + 1, 0);
+        bool has_uvs = true;
+        bool has_normals = true;
+        for (std::size_t c = 0; c < chunk_count; ++c) {
+            position_offsets[c + 1] = position_offsets[c] + chunks[c].positions.size() / 3;
+            uv_offsets[c + 1] = uv_offsets[c] + chunks[c].uvs.size() / 2;
+            normal_offsets[c + 1] = normal_offsets[c] + chunks[c].normals.size() / 3;
+            corner_offsets[c + 1] = corner_offsets[c] + chunks[c].corners.size() / 3;
+            has_uvs = has_uvs && chunks[c].has_uvs;
+            has_normals = has_normals && chunks[c].has_normals;
+        }
+        const std::size_t position_count = position_offsets[chunk_count];
+        const std::size_t uv_count = uv_offsets[chunk_count];
+        const std::size_t normal_count = normal_offsets[chunk_count];
+        if (position_count > std::size_t(std::numeric_limits<int>::max())
+            || corner_offsets[chunk_count] > std::size_t(std::numeric_limits<int>::max())) {
+            throw std::invalid_argument("The mesh has too many vertices.");
+        }
+        has_uvs = has_uvs && uv_count > 0;
+        has_normals = has_normals && normal_count > 0;
+
+        // Resolve the relative indices, and check that every index refers to vertex data that exists.
+        run_for_each(chunk_count, [&](std::size_t c) {
+            ObjChunk& chunk = chunks[c];
+            const int offsets[3] = {int(position_offsets[c]), int(uv_offsets[c]), int(normal_offsets[c])};
+            for (const std::size_t slot : chunk.relative_slots) {
+                chunk.corners[slot] += offsets[slot % 3];
+                if (chunk.corners[slot] < 0) {
+                    throw std::invalid_argument("A face refers to vertex data that does not exist.");
+                }
+            }
+            const int counts[3] = {int(position_count), int(uv_count), int(normal_count)};
+            for (std::size_t slot = 0; slot < chunk.corners.size(); ++slot) {
+                const int index = chunk.corners[slot];
+                const bool is_absent = index == absent_index && slot % 3 != 0;
+                if (!is_absent && (index < 0 || index >= counts[slot % 3])) {
+                    throw std::invalid_argument("A face refers to vertex data that does not exist.");
+                }
+            }
+        });
+
+        MeshData mesh;
+        mesh.indices.resize(corner_offsets[chunk_count]);
+        if (!has_uvs && !has_normals) {
+            // Each position is a vertex of its own.
+            mesh.positions.resize(position_count);
+            run_for_each(chunk_count, [&](std::size_t c) {
+                const ObjChunk& chunk = chunks[c];
+                for (std::size_t k = 0; k < chunk.positions.size() / 3; ++k) {
+                    mesh.positions[position_offsets[c] + k] = BoundVec3(chunk.positions[3 * k],
+                                                                        chunk.positions[3 * k + 1],
+                                                                        chunk.positions[3 * k + 2]);
+                }
+                for (std::size_t k = 0; k < chunk.corners.size() / 3; ++k) {
+                    mesh.indices[corner_offsets[c] + k] = chunk.corners[3 * k];
+                }
+            });
+            return mesh;
+        }
+
+        // Gather the vertex data of every chunk, since corners may refer to that of any chunk.
+        std::vector<value_type> positions(3 * position_count), uvs(2 * uv_count), normals(3 * normal_count);
+        run_for_each(chunk_count, [&](std::size_t c) {
+            const ObjChunk& chunk = chunks[c];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + 3 * position_offsets[c]);
+            std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + 2 * uv_offsets[c]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + 3 * normal_offsets[c]);
+        });
+
+        // Deduplicate the corners. The vertices made from each position are chained together, and a corner
+        // becomes the vertex of its chain whose texture coordinates and normal it shares.
+        std::vector<int> first_vertex(position_count, -1);
+        std::vector<int> next_vertex;
+        // The position, texture coordinate, and normal indices of each vertex.
+        std::vector<int> vertex_corners;
+        std::size_t corner = 0;
+        for (const ObjChunk& chunk : chunks) {
+            for (std::size_t slot = 0; slot < chunk.corners.size(); slot += 3) {
+                const int position = chunk.corners[slot];
+                const int uv = has_uvs ? chunk.corners[slot + 1] : absent_index;
+                const int normal = has_normals ? chunk.corners[slot + 2] : absent_index;
+                int vertex = first_vertex[position];
+                while (vertex >= 0 && (vertex_corners[3 * vertex + 1] != uv || vertex_corners[3 * vertex + 2] != normal)) {
+                    vertex = next_vertex[vertex];
+                }
+                if (vertex < 0) {
+                    vertex = int(next_vertex.size());
+                    next_vertex.push_back(first_vertex[position]);
+                    first_vertex[position] = vertex;
+                    vertex_corners.insert(vertex_corners.end(), {position, uv, normal});
+                }
+                mesh.indices[corner++] = vertex;
+            }
+        }
+
+        const std::size_t vertex_count = next_vertex.size();
+        mesh.positions.resize(vertex_count);
+        if (has_uvs) mesh.uvs.resize(2 * vertex_count);
+        if (has_normals) mesh.normals.resize(vertex_count);
+        run_for_each((vertex_count + element_chunk_size - 1) / element_chunk_size, [&](std::size_t chunk) {
+            const std::size_t end = std::min(vertex_count, (chunk + 1) * element_chunk_size);
+            for (std::size_t vertex = chunk * element_chunk_size; vertex < end; ++vertex) {
+                const int* indices = &vertex_corners[3 * vertex];
+                const value_type* position = &positions[3 * std::size_t(indices[0])];
+                mesh.positions[vertex] = BoundVec3(position[0], position[1], position[2]);
+                if (has_uvs) {
+                    mesh.uvs[2 * vertex] = uvs[2 * std::size_t(indices[1])];
+                    mesh.uvs[2 * vertex + 1] = uvs[2 * std::size_t(indices[1]) + 1];
+                }
+                if (has_normals) {
+                    const value_type* normal = &normals[3 * std::size_t(indices[2])];
+                    mesh.normals[vertex] = FreeVec3(normal[0], normal[1], normal[2]);
+                }
+            }
+        });
+        return mesh;
+    }
+
+    // Reads a binary PLY file of 'size' bytes, of either byte order. The vertex element gives the positions
+    // (x, y, z), and optionally normals (nx, ny, nz) and texture coordinates (u, v or s, t), and the face
+    // element gives the vertex indices of each face (vertex_indices or vertex_index), which are split into
+    // fans of triangles. Other elements and properties are skipped. PLY vertices are already shared
+    // between faces, so they are kept as they are.
+    MeshData read_ply(const char* data, std::size_t size) {
+        const std::size_t header_size = find_ply_header_end(data, size);
+        std::istringstream header(std::string(data, header_size));
+        std::string line;
+        std::getline(header, line);
+        std::vector<PlyElement> elements;
+        bool is_big_endian = false;
+        while (std::getline(header, line)) {
+            std::istringstream words(line);
+            std::string keyword;
+            words >> keyword;
+            if (keyword == "format") {
+                std::string format;
+                words >> format;
+                if (format == "ascii") {
+                    throw std::invalid_argument("Only binary PLY files are supported.");
+                }
+                if (format != "binary_little_endian" && format != "binary_big_endian") {
+                    throw std::invalid_argument("Unknown PLY format '" + format + "'.");
+                }
+                is_big_endian = format == "binary_big_endian";
+            } else if (keyword == "element") {
+                PlyElement element;
+                if (!(words >> element.name >> element.count)) {
+                    throw std::invalid_argument("Malformed PLY element '" + line + "'.");
+                }
+                elements.push_back(element);
+            } else if (keyword == "property") {
+                if (elements.empty()) {
+                    throw std::invalid_argument("A PLY property precedes every element.");
+                }
+                PlyProperty property;
+                std::string type;
+                words >> type;
+                if (type == "list") {
+                    std::string count_type;
+                    words >> count_type >> type;
+                    property.is_list = true;
+                    property.count_type = ply_type(count_type);
+                }
+                property.type = ply_type(type);
+                if (!(words >> property.name)) {
+                    throw std::invalid_argument("Malformed PLY property '" + line + "'.");
+                }
+                elements.back().properties.push_back(property);
+            }
+        }
+
+        // Values are copied out byte by byte, and reversed if the file's byte order differs from this machine's.
+        const bool swap = is_big_endian != (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__);
+        MeshData mesh;
+        std::size_t vertex_count = 0;
+        for (const PlyElement& element : elements) {
+            if (element.name == "vertex") vertex_count = element.count;
+        }
+        if (vertex_count > std::size_t(std::numeric_limits<int>::max())) {
+            throw std::invalid_argument("The mesh has too many vertices.");
+        }
+        std::size_t offset = header_size;
+        for (const PlyElement& element : elements) {
+            if (element.name == "vertex") {
+                offset = read_ply_vertices(data, size, offset, element, swap, mesh);
+            } else if (element.name == "face") {
+                offset = read_ply_faces(data, size, offset, element, swap, int(vertex_count), mesh);
+            } else {
+                offset = skip_ply_element(data, size, offset, element, swap);
+            }
+        }
+        return mesh;
+    }
+
+private:
+    // The part of an OBJ file parsed by one task: a run of whole lines.
+    struct ObjChunk {
+        const char* begin;
+        const char* end;
+        // The vertex data of the chunk: three values per position or normal, and two per texture coordinate pair.
+        std::vector<value_type> positions;
+        std::vector<value_type> uvs;
+        std::vector<value_type> normals;
+        // The corners of the chunk's triangles, three per triangle, each as the indices of its position,
+        // texture coordinates, and normal (or absent_index), counted from 0 across the whole file.
+        // A relative index (negative in the file) is counted from the start of the chunk until its slot,
+        // listed in 'relative_slots', is resolved.
+        std::vector<int> corners;
+        std::vector<std::size_t> relative_slots;
+        // Whether every corner has texture coordinates, and a normal.
+        bool has_uvs = true;
+        bool has_normals = true;
+    };
+
+    // A corner of an OBJ face, before the face is split into triangles.
+    struct ObjCorner {
+        int indices[3];
+        bool is_relative[3];
+    };
+
+    struct PlyProperty {
+        std::string name;
+        PLY_TYPE type;
+        // For a list, the type of the count of values that precedes them.
+        bool is_list = false;
+        PLY_TYPE count_type = PLY_UINT8;
+    };
+
+    struct PlyElement {
+        std::string name;
+        std::size_t count = 0;
+        std::vector<PlyProperty> properties;
+    };
+
+    // The number of bytes of an OBJ file parsed by one task, enough to make the task's overhead negligible.
+    static constexpr std::size_t obj_chunk_size = std::size_t(1) << 22;
+    // The number of vertices or faces handled by one task.
+    static constexpr std::size_t element_chunk_size = std::size_t(1) << 16;
+    static constexpr int absent_index = -1;
+
+    // Runs 'function' for each index below 'count' on the pool.
+    void run_for_each(std::size_t count, const std::function<void(std::size_t)>& function) {
+        std::vector<std::function<void()>> tasks;
+        tasks.reserve(count);
+        for (std::size_t k = 0; k < count; ++k) {
+            tasks.emplace_back([&function, k]() { function(k); });
+        }
+        pool_.run(tasks);
+    }
+
+    static bool is_blank(char character) {
+        return character == ' ' || character == '\t' || character == '\r';
+    }
+
+    static const char* skip_blanks(const char* p, const char* end) {
+        while (p < end && is_blank(*p)) ++p;
+        return p;
+    }
+
+    // Reads the number at 'p' (after any blanks), moving past it. Returns false if there is none.
+    static bool read_number(const char*& p, const char* end, value_type& value) {
+        p = skip_blanks(p, end);
+        if (p < end && *p == '+') ++p;
+        const auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) return false;
+        p = result.ptr;
+        return true;
+    }
+
+    [[noreturn]] static void malformed_obj_line(const char* line, const char* end) {
+        if (end > line && end[-1] == '\r') --end;
+        throw std::invalid_argument("Malformed OBJ line '" + std::string(line, end) + "'.");
+    }
+
+    static void parse_obj_chunk(ObjChunk& chunk) {
+        std::vector<ObjCorner> face;
+        for (const char* line = chunk.begin; line < chunk.end; ) {
+            const void* newline = std::memchr(line, '\n', chunk.end - line);
+            const char* line_end = newline ? static_cast<const char*>(newline) : chunk.end;
+            parse_obj_line(chunk, line, line_end, face);
+            line = line_end + 1;
+        }
+    }
+
+    static void parse_obj_line(ObjChunk& chunk, const char* line, const char* end, std::vector<ObjCorner>& face) {
+        // A comment runs from '#' to the end of the line, whether the line is a statement or not.
+        const void* comment = std::memchr(line, '#', end - line);
+        if (comment) end = static_cast<const char*>(comment);
+        const char* p = skip_blanks(line, end);
+        if (end - p < 2 || (p[0] != 'v' && p[0] != 'f')) return;
+        if (p[0] == 'v' && is_blank(p[1])) {
+            ++p;
+            value_type x, y, z;
+            if (!read_number(p, end, x) || !read_number(p, end, y) || !read_number(p, end, z)) {
+                malformed_obj_line(line, end);
+            }
+            chunk.positions.insert(chunk.positions.end(), {x, y, z});
+        } else if (p[0] == 'v' && p[1] == 'n' && end - p > 2 && is_blank(p[2])) {
+            p += 2;
+            value_type x, y, z;
+            if (!read_number(p, end, x) || !read_number(p, end, y) || !read_number(p, end, z)) {
+                malformed_obj_line(line, end);
+            }
+            chunk.normals.insert(chunk.normals.end(), {x, y, z});
+        } else if (p[0] == 'v' && p[1] == 't' && end - p > 2 && is_blank(p[2])) {
+            p += 2;
+            value_type u, v = 0.0;
+            if (!read_number(p, end, u)) malformed_obj_line(line, end);
+            if (skip_blanks(p, end) < end && !read_number(p, end, v)) malformed_obj_line(line, end);
+            chunk.uvs.insert(chunk.uvs.end(), {u, v});
+        } else if (p[0] == 'f' && is_blank(p[1])) {
+            ++p;
+            parse_obj_face(chunk, line, p, end, face);
+        }
+    }
+
+    // Parses the corners of a face from 'p', and adds them to the chunk as a fan of triangles.
+    static void parse_obj_face(ObjChunk& chunk, const char* line, const char* p, const char* end,
+                               std::vector<ObjCorner>& face) {
+        const std::size_t counts[3] = {chunk.positions.size() / 3, chunk.uvs.size() / 2, chunk.normals.size() / 3};
+        face.clear();
+        for (p = skip_blanks(p, end); p < end; p = skip_blanks(p, end)) {
+            ObjCorner corner{{absent_index, absent_index, absent_index}, {false, false, false}};
+            for (int attribute = 0; attribute < 3; ++attribute) {
+                // Texture coordinates may be left out between two slashes, as in "1//2".
+                if (attribute > 0 && (p >= end || *p != '/')) break;
+                if (attribute > 0) ++p;
+                if (attribute == 1 && p < end && *p == '/') continue;
+                int index = 0;
+                const auto result = std::from_chars(p, end, index);
+                if (result.ec != std::errc() || index == 0) malformed_obj_line(line, end);
+                p = result.ptr;
+                // Indices count from 1, or back from the last vertex data so far if negative.
+                corner.is_relative[attribute] = index < 0;
+                corner.indices[attribute] = index > 0 ? index - 1 : int(counts[attribute]) + index;
+            }
+            if (p < end && !is_blank(*p)) malformed_obj_line(line, end);
+            chunk.has_uvs = chunk.has_uvs && (corner.indices[1] != absent_index || corner.is_relative[1]);
+            chunk.has_normals = chunk.has_normals && (corner.indices[2] != absent_index || corner.is_relative[2]);
+            face.push_back(corner);
+        }
+        if (face.size() < 3) malformed_obj_line(line, end);
+        for (std::size_t k = 2; k < face.size(); ++k) {
+            for (const ObjCorner* corner : {&face[0], &face[k - 1], &face[k]}) {
+                for (int attribute = 0; attribute < 3; ++attribute) {
+                    if (corner->is_relative[attribute]) chunk.relative_slots.push_back(chunk.corners.size());
+                    chunk.corners.push_back(corner->indices[attribute]);
+                }
+            }
+        }
+    }
+
+    // The size of the header of a PLY file, up to and including its end_header line.
+    static std::size_t find_ply_header_end(const char* data, std::size_t size) {
+        const std::string_view text(data, size);
+        for (std::size_t line = 0; line < size; ) {
+            std::size_t newline = text.find('\n', line);
+            if (newline == std::string_view::npos) break;
+            std::string_view content = text.substr(line, newline - line);
+            if (!content.empty() && content.back() == '\r') content.remove_suffix(1);
+            if (content == "end_header") return newline + 1;
+            line = newline + 1;
+        }
+        throw std::invalid_argument("The PLY header has no end_header line.");
+    }
+
+    static PLY_TYPE ply_type(const std::string& name) {
+        if (name == "char" || name == "int8") return PLY_INT8;
+        if (name == "uchar" || name == "uint8") return PLY_UINT8;
+        if (name == "short" || name == "int16") return PLY_INT16;
+        if (name == "ushort" || name == "uint16") return PLY_UINT16;
+        if (name == "int" || name == "int32") return PLY_INT32;
+        if (name == "uint" || name == "uint32") return PLY_UINT32;
+        if (name == "float" || name == "float32") return PLY_FLOAT32;
+        if (name == "double" || name == "float64") return PLY_FLOAT64;
+        throw std::invalid_argument("Unknown PLY type '" + name + "'.");
+    }
+
+    static std::size_t ply_type_size(PLY_TYPE type) {
+        switch (type) {
+            case PLY_INT8: case PLY_UINT8: return 1;
+            case PLY_INT16: case PLY_UINT16: return 2;
+            case PLY_INT32: case PLY_UINT32: case PLY_FLOAT32: return 4;
+            default: return 8;
+        }
+    }
+
+    template<typename T>
+    static T load_ply_value(const char* bytes, bool swap) {
+        char copy[sizeof(T)];
+        if (swap) std::reverse_copy(bytes, bytes + sizeof(T), copy);
+        else std::memcpy(copy, bytes, sizeof(T));
+        T value;
+        std::memcpy(&value, copy, sizeof(T));
+        return value;
+    }
+
+    static value_type read_ply_value(const char* bytes, PLY_TYPE type, bool swap) {
+        switch (type) {
+            case PLY_INT8: return load_ply_value<int8_t>(bytes, swap);
+            case PLY_UINT8: return load_ply_value<uint8_t>(bytes, swap);
+            case PLY_INT16: return load_ply_value<int16_t>(bytes, swap);
+            case PLY_UINT16: return load_ply_value<uint16_t>(bytes, swap);
+            case PLY_INT32: return load_ply_value<int32_t>(bytes, swap);
+            case PLY_UINT32: return load_ply_value<uint32_t>(bytes, swap);
+            case PLY_FLOAT32: return load_ply_value<float>(bytes, swap);
+            default: return load_ply_value<double>(bytes, swap);
+        }
+    }
+
+    static long long read_ply_integer(const char* bytes, PLY_TYPE type, bool swap) {
+        switch (type) {
+            case PLY_INT8: return load_ply_value<int8_t>(bytes, swap);
+            case PLY_UINT8: return load_ply_value<uint8_t>(bytes, swap);
+            case PLY_INT16: return load_ply_value<int16_t>(bytes, swap);
+            case PLY_UINT16: return load_ply_value<uint16_t>(bytes, swap);
+            case PLY_INT32: return load_ply_value<int32_t>(bytes, swap);
+            case PLY_UINT32: return load_ply_value<uint32_t>(bytes, swap);
+            default: throw std::invalid_argument("PLY counts and indices must be integers.");
+        }
+    }
+
+    [[noreturn]] static void truncated_ply() {
+        throw std::invalid_argument("The PLY file ends before its last element.");
+    }
+
+    // The size of each record of 'element' if none of its properties is a list, or else 0.
+    static std::size_t fixed_record_size(const PlyElement& element) {
+        std::size_t record_size = 0;
+        for (const PlyProperty& property : element.properties) {
+            if (property.is_list) return 0;
+            record_size += ply_type_size(property.type);
+        }
+        return record_size;
+    }
+
+    // Skips the records of 'element' starting at 'offset', and returns the offset after them.
+    static std::size_t skip_ply_element(const char* data, std::size_t size, std::size_t offset,
+                                        const PlyElement& element, bool swap) {
+        const std::size_t record_size = fixed_record_size(element);
+        if (record_size > 0) {
+            if (element.count > (size - offset) / record_size) truncated_ply();
+            return offset + element.count * record_size;
+        }
+        for (std::size_t record = 0; record < element.count; ++record) {
+            for (const PlyProperty& property : element.properties) {
+                std::size_t length = ply_type_size(property.type);
+                if (property.is_list) {
+                    const std::size_t count_size = ply_type_size(property.count_type);
+                    if (offset + count_size > size) truncated_ply();
+                    length = count_size + length * std::size_t(read_ply_integer(data + offset, property.count_type, swap));
+                }
+                if (length > size - offset) truncated_ply();
+                offset += length;
+            }
+        }
+        return offset;
+    }
+
+    // Reads the vertex element starting at 'offset' into 'mesh', and returns the offset after it.
+    std::size_t read_ply_vertices(const char* data, std::size_t size, std::size_t offset, const PlyElement& element,
+                                  bool swap, MeshData& mesh) {
+        const std::size_t record_size = fixed_record_size(element);
+        if (record_size == 0) {
+            throw std::invalid_argument("PLY vertices with list properties are not supported.");
+        }
+        if (element.count > (size - offset) / record_size) truncated_ply();
+
+        // The property of each attribute, by its offset within a record and its type.
+        enum {X, Y, Z, NX, NY, NZ, U, V, ATTRIBUTE_COUNT};
+        const char* const names[ATTRIBUTE_COUNT][4] = {{"x"}, {"y"}, {"z"}, {"nx"}, {"ny"}, {"nz"},
+                                                       {"u", "s", "texture_u", "texture_s"},
+                                                       {"v", "t", "texture_v", "texture_t"}};
+        std::size_t offsets[ATTRIBUTE_COUNT];
+        PLY_TYPE types[ATTRIBUTE_COUNT];
+        bool has[ATTRIBUTE_COUNT] = {};
+        std::size_t property_offset = 0;
+        for (const PlyProperty& property : element.properties) {
+            for (int attribute = 0; attribute < ATTRIBUTE_COUNT; ++attribute) {
+                for (const char* name : names[attribute]) {
+                    if (name && property.name == name && !has[attribute]) {
+                        has[attribute] = true;
+                        offsets[attribute] = property_offset;
+                        types[attribute] = property.type;
+                    }
+                }
+            }
+            property_offset += ply_type_size(property.type);
+        }
+        if (!has[X] || !has[Y] || !has[Z]) {
+            throw std::invalid_argument("PLY vertices must have x, y, and z properties.");
+        }
+        const bool has_normals = has[NX] && has[NY] && has[NZ];
+        const bool has_uvs = has[U] && has[V];
+
+        mesh.positions.resize(element.count);
+        if (has_normals) mesh.normals.resize(element.count);
+        if (has_uvs) mesh.uvs.resize(2 * element.count);
+        run_for_each((element.count + element_chunk_size - 1) / element_chunk_size, [&](std::size_t chunk) {
+            const std::size_t end = std::min(element.count, (chunk + 1) * element_chunk_size);
+            for (std::size_t vertex = chunk * element_chunk_size; vertex < end; ++vertex) {
+                const char* record = data + offset + vertex * record_size;
+                const auto value = [&](int attribute) {
+                    return read_ply_value(record + offsets[attribute], types[attribute], swap);
+                };
+                mesh.positions[vertex] = BoundVec3(value(X), value(Y), value(Z));
+                if (has_normals) mesh.normals[vertex] = FreeVec3(value(NX), value(NY), value(NZ));
+                if (has_uvs) {
+                    mesh.uvs[2 * vertex] = value(U);
+                    mesh.uvs[2 * vertex + 1] = value(V);
+                }
+            }
+        });
+        return offset + element.count * record_size;
+    }
+
+    // Reads the face element starting at 'offset' into 'mesh', and returns the offset after it.
+    std::size_t read_ply_faces(const char* data, std::size_t size, std::size_t offset, const PlyElement& element,
+                               bool swap, int vertex_count, MeshData& mesh) {
+        // The vertex index list, its offset within a record, and the size of the other properties, for when
+        // every other property is of fixed size.
+        const PlyProperty* index_list = nullptr;
+        std::size_t list_offset = 0;
+        std::size_t other_size = 0;
+        bool has_other_lists = false;
+        for (const PlyProperty& property : element.properties) {
+            if (property.is_list && (property.name == "vertex_indices" || property.name == "vertex_index")) {
+                index_list = &property;
+                continue;
+            }
+            has_other_lists = has_other_lists || property.is_list;
+            if (!index_list) list_offset += ply_type_size(property.type);
+            other_size += ply_type_size(property.type);
+        }
+        if (!index_list) {
+            throw std::invalid_argument("PLY faces must have a vertex_indices list.");
+        }
+        const std::size_t count_size = ply_type_size(index_list->count_type);
+        const std::size_t index_size = ply_type_size(index_list->type);
+        const auto read_index = [&](const char* bytes) {
+            const long long index = read_ply_integer(bytes, index_list->type, swap);
+            if (index < 0 || index >= vertex_count) {
+                throw std::invalid_argument("A PLY face refers to a vertex that does not exist.");
+            }
+            return int(index);
+        };
+
+        // Most files have faces with the same number of vertices, typically triangles, whose records then all
+        // have the same size. The faces are then read in parallel, each straight into its place. Until the
+        // whole pass has confirmed that, a record may be misaligned, so indices out of range are only noted.
+        if (!has_other_lists && element.count > 0 && offset + list_offset + count_size <= size) {
+            const long long corner_count = read_ply_integer(data + offset + list_offset, index_list->count_type, swap);
+            const std::size_t record_size = other_size + count_size + index_size * std::size_t(std::max(0LL, corner_count));
+            if (corner_count >= 3 && element.count <= (size - offset) / record_size) {
+                const std::size_t triangles_per_face = std::size_t(corner_count) - 2;
+                mesh.indices.resize(3 * triangles_per_face * element.count);
+                std::atomic<bool> is_uniform{true};
+                std::atomic<bool> is_in_range{true};
+                run_for_each((element.count + element_chunk_size - 1) / element_chunk_size, [&](std::size_t chunk) {
+                    const std::size_t end = std::min(element.count, (chunk + 1) * element_chunk_size);
+                    for (std::size_t face = chunk * element_chunk_size; face < end && is_uniform; ++face) {
+                        const char* list = data + offset + face * record_size + list_offset;
+                        if (read_ply_integer(list, index_list->count_type, swap) != corner_count) {
+                            is_uniform = false;
+                            break;
+                        }
+                        const char* indices = list + count_size;
+                        int* triangles = &mesh.indices[3 * triangles_per_face * face];
+                        const auto read_unchecked_index = [&](std::size_t k) {
+                            const long long index = read_ply_integer(indices + k * index_size, index_list->type, swap);
+                            if (index < 0 || index >= vertex_count) is_in_range = false;
+                            return int(index);
+                        };
+                        const int first = read_unchecked_index(0);
+                        int previous = read_unchecked_index(1);
+                        for (std::size_t k = 2; k < std::size_t(corner_count); ++k) {
+                            const int current = read_unchecked_index(k);
+                            *triangles++ = first;
+                            *triangles++ = previous;
+                            *triangles++ = current;
+                            previous = current;
+                        }
+                    }
+                });
+                if (is_uniform && !is_in_range) {
+                    throw std::invalid_argument("A PLY face refers to a vertex that does not exist.");
+                }
+                if (is_uniform) return offset + element.count * record_size;
+                mesh.indices.clear();
+            }
+        }
+
+        // Otherwise the faces are read one after another, since each one's place depends on those before it.
+        for (std::size_t face = 0; face < element.count; ++face) {
+            for (const PlyProperty& property : element.properties) {
+                std::size_t length = ply_type_size(property.type);
+                if (property.is_list) {
+                    if (offset + ply_type_size(property.count_type) > size) truncated_ply();
+                    const std::size_t count = std::size_t(read_ply_integer(data + offset, property.count_type, swap));
+                    length = ply_type_size(property.count_type) + length * count;
+                    if (length > size - offset) truncated_ply();
+                    if (&property == index_list && count >= 3) {
+                        const char* indices = data + offset + count_size;
+                        const int first = read_index(indices);
+                        int previous = read_index(indices + index_size);
+                        for (std::size_t k = 2; k < count; ++k) {
+                            const int current = read_index(indices + k * index_size);
+                            mesh.indices.insert(mesh.indices.end(), {first, previous, current});
+                            previous = current;
+                        }
+                    }
+                }
+                if (length > size - offset) truncated_ply();
+                offset += length;
+            }
+        }
+        return offset;
+    }
+
+    WorkStealingThreadPool pool_;
+};
+
+#endif //RAYTRACING_MESHIMPORT_H
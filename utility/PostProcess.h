@@ -0,0 +1,173 @@
+#ifndef RAYTRACING_POSTPROCESS_H
+#define RAYTRACING_POSTPROCESS_H
+#include "Framebuffer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The encoding loop uses SSE when the compiler targets it, unless RAYTRACING_DISABLE_SIMD is defined.
+// Otherwise, or for a gamma other than 1 or 2, it falls back to a scalar loop computing the same values.
+#if !defined(RAYTRACING_DISABLE_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define RAYTRACING_POST_PROCESS_SSE
+#endif
+
+// How linear colors are compressed into the range from black to full brightness.
+enum TONE_MAPPING {
+    // Values above full brightness are clipped to it.
+    CLAMP,
+    // x / (1 + x), which approaches full brightness without reaching it.
+    REINHARD,
+    // Narkowicz's fit of the ACES filmic curve, which also adds contrast.
+    ACES_FILMIC
+};
+
+// The tone mapping named 'name': clamp, reinhard, or aces.
+inline TONE_MAPPING tone_mapping(const std::string& name) {
+    if (name == "clamp") return CLAMP;
+    if (name == "reinhard") return REINHARD;
+    if (name == "aces") return ACES_FILMIC;
+    throw std::invalid_argument("Unknown tone mapping '" + name + "'; expected clamp, reinhard, or aces.");
+}
+
+// How a rendered Framebuffer is turned into displayable color values. Each value is, in order:
+// scrubbed (NaN and negative values become black), scaled by the exposure, tone mapped, gamma encoded,
+// and quantized to an integer from 0 to max_color.
+struct PostProcessSettings {
+    // In stops: each stop doubles the brightness.
+    value_type exposure = 0.0;
+    TONE_MAPPING tone_mapping = CLAMP;
+    // E.g. 2.0 for the square root of each value, or 1.0 to keep them linear.
+    value_type gamma = 2.0;
+    // The value of full brightness, at most 65535.
+    int max_color = 255;
+};
+
+// Post-processes 'count' values of one channel, as described by PostProcessSettings, into 'encoded'.
+inline void encode_values(const float* values, std::size_t count, const PostProcessSettings& settings,
+                          uint16_t* encoded) {
+    if (settings.gamma <= 0.0 || settings.max_color <= 0 || settings.max_color > 65535) {
+        throw std::invalid_argument("The gamma and maximum color value must be positive, and the latter at most 65535.");
+    }
+    const float scale = float(std::exp2(settings.exposure));
+    const float max_color = float(settings.max_color);
+    const float inverse_gamma = float(1.0 / settings.gamma);
+    std::size_t k = 0;
+
+#if defined(RAYTRACING_POST_PROCESS_SSE)
+    // As with minps and maxps, the scalar loop below keeps the second operand when either is NaN.
+    if (settings.gamma == 1.0 || settings.gamma == 2.0) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 scales = _mm_set1_ps(scale);
+        const __m128 max_colors = _mm_set1_ps(max_color);
+        for (; k + 4 <= count; k += 4) {
+            __m128 x = _mm_mul_ps(_mm_max_ps(_mm_loadu_ps(values + k), zero), scales);
+            if (settings.tone_mapping == REINHARD) {
+                x = _mm_div_ps(x, _mm_add_ps(one, x));
+            } else if (settings.tone_mapping == ACES_FILMIC) {
+                const __m128 numerator = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), x), _mm_set1_ps(0.03f)));
+                const __m128 denominator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), x),
+                                                                               _mm_set1_ps(0.59f))),
+                                                      _mm_set1_ps(0.14f));
+                x = _mm_div_ps(numerator, denominator);
+            }
+            x = _mm_min_ps(x, one);
+            if (settings.gamma == 2.0) x = _mm_sqrt_ps(x);
+            const __m128i quantized = _mm_cvttps_epi32(_mm_mul_ps(x, max_colors));
+            alignas(16) int32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), quantized);
+            for (int lane = 0; lane < 4; ++lane) {
+                encoded[k + lane] = uint16_t(lanes[lane]);
+            }
+        }
+    }
+#endif
+
+    for (; k < count; ++k) {
+        float x = values[k] > 0.0f ? values[k] : 0.0f;
+        x *= scale;
+        if (settings.tone_mapping == REINHARD) {
+            x = x / (1.0f + x);
+        } else if (settings.tone_mapping == ACES_FILMIC) {
+            x = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+        }
+        x = x < 1.0f ? x : 1.0f;
+        if (settings.gamma == 2.0) x = std::sqrt(x);
+        else if (settings.gamma != 1.0) x = std::pow(x, inverse_gamma);
+        encoded[k] = uint16_t(x * max_color);
+    }
+}
+
+// A post-processed image: the displayable color values of each pixel, from 0 to max_color, kept in
+// planes as with Framebuffer.
+class DisplayImage {
+public:
+    DisplayImage(int width, int height) : width_{width}, height_{height},
+                                          planes_(3 * std::size_t(width) * height) {}
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    std::size_t pixel_count() const { return std::size_t(width_) * height_; }
+
+    // The values of 'channel' (0 for red, 1 for green, 2 for blue) of every pixel, row by row from the bottom.
+    const uint16_t* plane(int channel) const { return planes_.data() + channel * pixel_count(); }
+    uint16_t* plane(int channel) { return planes_.data() + channel * pixel_count(); }
+
+private:
+    int width_;
+    int height_;
+    std::vector<uint16_t> planes_;
+};
+
+// Post-processes whole Framebuffers on a pool of threads. Post-processing only reads the framebuffer,
+// so it can be run again with different settings without rendering again.
+class PostProcessor {
+public:
+    // Starts 'thread_count' threads, or one per hardware thread if 'thread_count' is not positive.
+    explicit PostProcessor(int thread_count = 0)
+            : owned_pool_{std::make_unique<WorkStealingThreadPool>(thread_count)}, pool_{*owned_pool_} {}
+
+    // Runs on the threads of 'pool' (e.g. those of a TileRenderer), which must outlive the PostProcessor
+    // and must not be running anything else while an image is being processed.
+    explicit PostProcessor(WorkStealingThreadPool& pool) : pool_{pool} {}
+
+    // Post-processes every pixel of 'framebuffer' into 'image', which must have the same dimensions.
+    void process(const Framebuffer& framebuffer, const PostProcessSettings& settings, DisplayImage& image) {
+        if (image.width() != framebuffer.width() || image.height() != framebuffer.height()) {
+            throw std::invalid_argument("DisplayImage dimensions do not match the Framebuffer.");
+        }
+        // Each task encodes a run of one plane, long enough to make the task's overhead negligible.
+        const std::size_t chunk_size = 1 << 16;
+        const std::size_t size = framebuffer.pixel_count();
+        std::vector<std::function<void()>> tasks;
+        for (int channel = 0; channel < 3; ++channel) {
+            for (std::size_t begin = 0; begin < size; begin += chunk_size) {
+                const std::size_t count = std::min(chunk_size, size - begin);
+                tasks.emplace_back([=, &framebuffer, &settings, &image]() {
+                    encode_values(framebuffer.plane(channel) + begin, count, settings, image.plane(channel) + begin);
+                });
+            }
+        }
+        pool_.run(tasks);
+    }
+
+    DisplayImage process(const Framebuffer& framebuffer, const PostProcessSettings& settings) {
+        DisplayImage image(framebuffer.width(), framebuffer.height());
+        process(framebuffer, settings, image);
+        return image;
+    }
+
+private:
+    std::unique_ptr<WorkStealingThreadPool> owned_pool_;
+    WorkStealingThreadPool& pool_;
+};
+
+#endif //RAYTRACING_POSTPROCESS_H
@@ -0,0 +1,45 @@
+#ifndef RAYTRACING_RAYPACKET_H
+#define RAYTRACING_RAYPACKET_H
+#include "Vec3.h"
+#include "Ray.h"
+
+// The largest number of rays a packet may hold.
+constexpr int max_packet_size = 16;
+
+// A group of coherent rays (e.g. the camera rays of neighbouring samples) traced together, so that
+// each acceleration structure node and each surface is fetched once for the whole group instead of
+// once per ray. Besides the rays themselves, their components are stored in structure-of-arrays form
+// so that the per-ray arithmetic of a packet test runs as a tight loop.
+// Sets of rays within a packet are given as bit masks, where bit i stands for ray i.
+struct RayPacket {
+    RayPacket() : size{0} {}
+
+    // Adds 'ray' to the packet. At most max_packet_size rays may be added.
+    void add(const Ray& ray) {
+        const int i = size++;
+        rays[i] = ray;
+        origin_x[i] = ray.origin().x();
+        origin_y[i] = ray.origin().y();
+        origin_z[i] = ray.origin().z();
+        direction_x[i] = ray.direction().x();
+        direction_y[i] = ray.direction().y();
+        direction_z[i] = ray.direction().z();
+        inverse_direction_x[i] = 1.0 / direction_x[i];
+        inverse_direction_y[i] = 1.0 / direction_y[i];
+        inverse_direction_z[i] = 1.0 / direction_z[i];
+    }
+
+    // The mask of every ray in the packet.
+    int all() const { return (1 << size) - 1; }
+
+    // The number of rays in the packet.
+    int size;
+    Ray rays[max_packet_size];
+    value_type origin_x[max_packet_size], origin_y[max_packet_size], origin_z[max_packet_size];
+    value_type direction_x[max_packet_size], direction_y[max_packet_size], direction_z[max_packet_size];
+    value_type inverse_direction_x[max_packet_size];
+    value_type inverse_direction_y[max_packet_size];
+    value_type inverse_direction_z[max_packet_size];
+};
+
+#endif //RAYTRACING_RAYPACKET_H
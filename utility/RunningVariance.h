@@ -0,0 +1,41 @@
+#ifndef RAYTRACING_RUNNINGVARIANCE_H
+#define RAYTRACING_RUNNINGVARIANCE_H
+#include "Vec3.h"
+
+// The mean and variance of a sequence of values, updated as each value is added, with Welford's
+// algorithm. Unlike a sum of values and a sum of their squares, it does not lose precision when the
+// variance is small compared to the mean.
+// See: https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Welford's_online_algorithm
+class RunningVariance {
+public:
+    void add(value_type value) {
+        ++count_;
+        const value_type delta = value - mean_;
+        mean_ += delta / value_type(count_);
+        squared_deviations_ += delta * (value - mean_);
+    }
+
+    int count() const { return count_; }
+
+    value_type mean() const { return mean_; }
+
+    // The unbiased sample variance, or 0.0 if fewer than two values have been added.
+    value_type variance() const {
+        return count_ < 2 ? value_type(0.0) : squared_deviations_ / value_type(count_ - 1);
+    }
+
+    // The variance, shrunk towards 'prior_variance' as if 'prior_weight' more values had had that variance.
+    // Few values may happen to be all alike, e.g. when they are the rare hits of a small light, and this
+    // keeps their variance from being taken for zero.
+    value_type variance(value_type prior_variance, value_type prior_weight) const {
+        return (squared_deviations_ + prior_weight * prior_variance) / (value_type(count_ - 1) + prior_weight);
+    }
+
+private:
+    int count_ = 0;
+    value_type mean_ = 0.0;
+    // The sum of the squared deviations from the mean.
+    value_type squared_deviations_ = 0.0;
+};
+
+#endif //RAYTRACING_RUNNINGVARIANCE_H
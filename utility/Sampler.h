@@ -0,0 +1,43 @@
+#ifndef RAYTRACING_SAMPLER_H
+#define RAYTRACING_SAMPLER_H
+#include "Vec3.h"
+#include <cstdint>
+
+// The random numbers used by one sample of one pixel. Rather than advancing a shared generator, each
+// value is computed from a counter: a hash of the render's seed, the pixel, the sample, and how many
+// values the sample has drawn so far (its dimension). A sample therefore sees the same values no matter
+// which thread renders it or in which order, so that renders are reproducible for a given seed
+// regardless of the number of threads. Constructing a sampler and drawing a value each take a few
+// multiplications, and a sampler holds no state beyond two integers.
+class Sampler {
+public:
+    Sampler() : Sampler(0, 0, 0) {}
+
+    // 'pixel' identifies the pixel (e.g. j * x_pixels + i), and 'sample' the sample within it.
+    Sampler(uint64_t seed, uint64_t pixel, uint64_t sample) : stream_{mix(mix(mix(seed) + pixel) + sample)},
+            dimension_{0} {}
+
+    // Returns the next value of the sample, uniformly distributed in [0.0, 1.0).
+    value_type next_value() {
+        const uint64_t bits = mix(stream_ + ++dimension_ * 0x9E3779B97F4A7C15ull);
+        // The top 53 bits fill the mantissa of a double exactly.
+        return value_type(bits >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // The number of values drawn so far.
+    uint64_t dimension() const { return dimension_; }
+
+private:
+    // The finalizer of the SplitMix64 generator, which maps consecutive integers to
+    // statistically independent ones.
+    static uint64_t mix(uint64_t value) {
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+    uint64_t stream_;
+    uint64_t dimension_;
+};
+
+#endif //RAYTRACING_SAMPLER_H
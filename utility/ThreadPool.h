@@ -0,0 +1,141 @@
+#ifndef RAYTRACING_THREADPOOL_H
+#define RAYTRACING_THREADPOOL_H
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that run batches of tasks. Each worker has its own queue of tasks:
+// it takes tasks from the back of its own queue, and once that is empty, steals from the front of
+// the other workers' queues. Tasks of uneven cost therefore end up spread over all the workers,
+// without the workers contending for a single shared queue.
+class WorkStealingThreadPool {
+public:
+    // Starts 'thread_count' workers, or one per hardware thread if 'thread_count' is not positive.
+    explicit WorkStealingThreadPool(int thread_count = 0) {
+        if (thread_count <= 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 0; i < thread_count; ++i) {
+            queues_.push_back(std::make_unique<WorkQueue>());
+        }
+        for (int i = 0; i < thread_count; ++i) {
+            threads_.emplace_back([this, i]() { work(i); });
+        }
+    }
+
+    WorkStealingThreadPool(const WorkStealingThreadPool&) = delete;
+    WorkStealingThreadPool& operator=(const WorkStealingThreadPool&) = delete;
+
+    ~WorkStealingThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        batch_started_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    int thread_count() const { return threads_.size(); }
+
+    // Runs every task, and returns once all of them have finished. The tasks are dealt out to the
+    // workers' queues in contiguous runs, so that neighbouring tasks (e.g. neighbouring tiles of an
+    // image) start on the same worker. If any task throws, the first exception is rethrown here.
+    // One batch runs at a time: run() must not be called from two threads at once, nor from a task.
+    void run(const std::vector<std::function<void()>>& tasks) {
+        if (tasks.empty()) return;
+        std::unique_lock<std::mutex> lock(mutex_);
+        tasks_ = &tasks;
+        remaining_ = tasks.size();
+        error_ = nullptr;
+        ++batch_;
+        const std::size_t run_length = (tasks.size() + queues_.size() - 1) / queues_.size();
+        for (std::size_t i = 0; i < tasks.size(); ++i) {
+            WorkQueue& queue = *queues_[i / run_length];
+            std::lock_guard<std::mutex> queue_lock(queue.mutex);
+            // Owners take from the back, so push in reverse to start each run at its first task.
+            queue.tasks.push_front(int(i));
+        }
+        batch_started_.notify_all();
+        batch_finished_.wait(lock, [this]() { return remaining_ == 0; });
+        tasks_ = nullptr;
+        if (error_) std::rethrow_exception(error_);
+    }
+
+private:
+    // The indices of the tasks a worker has been dealt.
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    void work(int index) {
+        long long batches_seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                batch_started_.wait(lock, [&]() { return stopping_ || batch_ != batches_seen; });
+                if (stopping_) return;
+                batches_seen = batch_;
+            }
+            int task;
+            while (take(index, task)) {
+                // A worker still looking for work from the previous batch may take a task of the next one,
+                // so the batch is looked up for each task. run() holds the lock while dealing out tasks.
+                const std::vector<std::function<void()>>* tasks;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    tasks = tasks_;
+                }
+                try {
+                    (*tasks)[task]();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (!error_) error_ = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--remaining_ == 0) batch_finished_.notify_all();
+            }
+        }
+    }
+
+    // Takes a task from the back of worker 'index''s own queue, or failing that, steals one from the
+    // front of another worker's queue. Returns false once every queue is empty.
+    bool take(int index, int& task) {
+        for (std::size_t k = 0; k < queues_.size(); ++k) {
+            WorkQueue& queue = *queues_[(index + k) % queues_.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) continue;
+            if (k == 0) {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+            } else {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::vector<std::thread> threads_;
+    // Guards everything below.
+    std::mutex mutex_;
+    std::condition_variable batch_started_;
+    std::condition_variable batch_finished_;
+    // The current batch, its number, and how many of its tasks have not finished.
+    const std::vector<std::function<void()>>* tasks_ = nullptr;
+    long long batch_ = 0;
+    int remaining_ = 0;
+    std::exception_ptr error_;
+    bool stopping_ = false;
+};
+
+#endif //RAYTRACING_THREADPOOL_H
@@ -0,0 +1,348 @@
+#ifndef RAYTRACING_TILERENDERER_H
+#define RAYTRACING_TILERENDERER_H
+#include "AccumulationBuffer.h"
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "RunningVariance.h"
+#include "ThreadPool.h"
+#include "../surfaces/Hittable.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+// How a render is divided between workers; see TileRenderer::render_share.
+enum RENDER_PARTITION {
+    // Each worker renders a contiguous range of the tiles.
+    TILE_RANGE,
+    // Each worker renders a contiguous range of the samples of every pixel.
+    SAMPLE_RANGE
+};
+
+// Configures a TileRenderer.
+struct RenderSettings {
+    // The number of samples averaged for each pixel, for antialiasing.
+    // With adaptive sampling, the most samples of a pixel, and with a time budget, the most it may reach.
+    int samples_per_pixel = 50;
+    // The number of samples per pixel whose primary rays are traced together (at most max_packet_size).
+    // A packet size of 1 traces each ray on its own.
+    int packet_size = 1;
+    // The width and height of a tile, in pixels.
+    int tile_size = 16;
+    // The number of threads rendering tiles, or 0 for one per hardware thread.
+    int thread_count = 0;
+    // Selects the random numbers of the render. Renders with the same seed are identical, whatever
+    // the number of threads.
+    uint64_t seed = 0;
+    // The number of bounces a path makes before Russian roulette may end it. Lower values render
+    // faster at the cost of more noise; a value of at least the maximum recursion depth disables it.
+    int russian_roulette_depth = default_russian_roulette_depth;
+    // In progressive rendering, the least number of seconds between checkpoints.
+    double checkpoint_interval = 60.0;
+    // If positive, render() samples adaptively: each pixel takes between minimum_samples_per_pixel and
+    // samples_per_pixel samples, stopping once its noise is at most this; see render_adaptive_tile.
+    // Adaptive samples are traced one at a time, regardless of packet_size.
+    value_type noise_threshold = 0.0;
+    // With adaptive sampling, the fewest samples of a pixel, and how many more it takes at a time.
+    int minimum_samples_per_pixel = 16;
+    // The number of paths a WavefrontRenderer keeps in flight.
+    int wavefront_size = 1 << 13;
+};
+
+// Renders images on a pool of threads. The image is divided into square tiles, each rendered as one
+// task of a WorkStealingThreadPool, so that threads which finish their share of cheap tiles (e.g. empty
+// background) take over tiles from threads still busy with expensive ones (e.g. around a light).
+class TileRenderer {
+public:
+    // Called with the bounds of a tile: pixels [i_begin, i_end) x [j_begin, j_end).
+    using TileFunction = std::function<void(int i_begin, int i_end, int j_begin, int j_end)>;
+
+    explicit TileRenderer(const RenderSettings& settings) : settings_{settings}, pool_{settings.thread_count} {}
+
+    int thread_count() const { return pool_.thread_count(); }
+
+    const RenderSettings& settings() const { return settings_; }
+
+    // Renders later images with 'settings', on the same threads, so their thread_count must be unchanged.
+    void set_settings(const RenderSettings& settings) {
+        if (settings.thread_count != settings_.thread_count) {
+            throw std::invalid_argument("The thread count of a TileRenderer cannot change.");
+        }
+        settings_ = settings;
+    }
+
+    // The threads the renderer runs on, for other work between renders (e.g. a PostProcessor).
+    WorkStealingThreadPool& pool() { return pool_; }
+
+    // Renders the world as seen by 'camera' into every pixel of 'framebuffer', and returns once all are done.
+    // If given, 'sample_counts' is filled with the number of samples each pixel took, row by row from the
+    // bottom as with Framebuffer, and 'tile_finished' is called by the rendering thread with the bounds of
+    // each tile once it is finished (e.g. to write the image as it is rendered; see AsyncImageWriter).
+    void render(const Camera* camera, const Hittable* world, int maximum_recursion_depth, Framebuffer& framebuffer,
+                std::vector<int>* sample_counts = nullptr, const TileFunction& tile_finished = nullptr) {
+        if (sample_counts) sample_counts->assign(framebuffer.width() * framebuffer.height(), 0);
+        const TileFunction tile_function = [&](int i_begin, int i_end, int j_begin, int j_end) {
+            render_tile(camera, world, maximum_recursion_depth, i_begin, i_end, j_begin, j_end, framebuffer,
+                        sample_counts);
+            if (tile_finished) tile_finished(i_begin, i_end, j_begin, j_end);
+        };
+        pool_.run(tiles(framebuffer.width(), framebuffer.height(), tile_function));
+    }
+
+    // Renders progressively: in each pass, adds one sample to every pixel of 'accumulation' with fewer than
+    // samples_per_pixel, until none is left. A pixel's samples are the same as those render() would
+    // take, so a render may be resumed from a buffer holding the samples of an earlier, interrupted one.
+    // If given, 'checkpoint' is called with the buffer (e.g. to save it) once at least checkpoint_interval
+    // seconds have passed since the previous call, and after the last pass.
+    void render_progressive(const Camera* camera, const Hittable* world, int maximum_recursion_depth,
+                            AccumulationBuffer& accumulation,
+                            const std::function<void(const AccumulationBuffer&)>& checkpoint = nullptr) {
+        const TileFunction tile_function = [&](int i_begin, int i_end, int j_begin, int j_end) {
+            render_pass_tile(camera, world, maximum_recursion_depth, i_begin, i_end, j_begin, j_end, accumulation);
+        };
+        const std::vector<std::function<void()>> pass = tiles(accumulation.width(), accumulation.height(), tile_function);
+        const uint32_t samples_per_pixel = settings_.samples_per_pixel;
+        auto last_checkpoint = std::chrono::steady_clock::now();
+        while (accumulation.minimum_sample_count() < samples_per_pixel) {
+            pool_.run(pass);
+            const auto now = std::chrono::steady_clock::now();
+            const bool is_last_pass = accumulation.minimum_sample_count() >= samples_per_pixel;
+            if (checkpoint && (is_last_pass
+                               || std::chrono::duration<double>(now - last_checkpoint).count() >= settings_.checkpoint_interval)) {
+                checkpoint(accumulation);
+                last_checkpoint = now;
+            }
+        }
+    }
+
+    // Renders within a wall-clock budget of 'seconds', adding samples to the pixels of 'accumulation' until
+    // either the time is up or every pixel has samples_per_pixel. A first pass adds one sample to every pixel,
+    // however long it takes, so that the image is complete; its duration estimates the cost of a pass. Then
+    // each batch adds half as many samples per pixel as are estimated to fit in the time left, and the
+    // estimate is refined with the batch's duration, until not even one more pass fits. A batch still running
+    // at the deadline stops, leaving its remaining pixels with one batch fewer. Thus the result is always a
+    // valid image, whose pixels' achieved numbers of samples are those of 'accumulation'.
+    // Returns the number of seconds spent.
+    double render_budgeted(const Camera* camera, const Hittable* world, int maximum_recursion_depth,
+                           AccumulationBuffer& accumulation, double seconds) {
+        using Clock = std::chrono::steady_clock;
+        const auto start = Clock::now();
+        const auto deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        int batch_samples = 1;
+        auto batch_deadline = Clock::time_point::max();
+        const TileFunction tile_function = [&](int i_begin, int i_end, int j_begin, int j_end) {
+            render_budgeted_tile(camera, world, maximum_recursion_depth, i_begin, i_end, j_begin, j_end,
+                                 batch_samples, batch_deadline, accumulation);
+        };
+        const std::vector<std::function<void()>> batch = tiles(accumulation.width(), accumulation.height(), tile_function);
+        const uint32_t samples_per_pixel = settings_.samples_per_pixel;
+        pool_.run(batch);
+        int passes = 1;
+        batch_deadline = deadline;
+        while (accumulation.minimum_sample_count() < samples_per_pixel) {
+            const auto now = Clock::now();
+            const double seconds_per_pass = std::chrono::duration<double>(now - start).count() / passes;
+            const double seconds_left = std::chrono::duration<double>(deadline - now).count();
+            const int fitting_passes = int(std::min(seconds_left / seconds_per_pass, double(samples_per_pixel)));
+            if (fitting_passes < 1) break;
+            batch_samples = std::max(1, fitting_passes / 2);
+            pool_.run(batch);
+            passes += batch_samples;
+        }
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Renders worker 'worker''s share of a render divided by 'partition' between 'worker_count' workers,
+    // e.g. separate processes, adding its samples to 'accumulation'. A sample is the same whichever worker
+    // takes it, so merging the buffers of all the workers (see AccumulationBuffer::merge) gives the same
+    // image as a single render_progressive.
+    void render_share(const Camera* camera, const Hittable* world, int maximum_recursion_depth,
+                      AccumulationBuffer& accumulation, int worker, int worker_count, RENDER_PARTITION partition) {
+        if (worker_count <= 0 || worker < 0 || worker >= worker_count) {
+            throw std::invalid_argument("The worker must be one of a positive number of workers.");
+        }
+        const bool by_samples = partition == SAMPLE_RANGE;
+        const long long samples_per_pixel = settings_.samples_per_pixel;
+        const int first_sample = by_samples ? int(samples_per_pixel * worker / worker_count) : 0;
+        const int end_sample = by_samples ? int(samples_per_pixel * (worker + 1) / worker_count) : samples_per_pixel;
+        const TileFunction tile_function = [&](int i_begin, int i_end, int j_begin, int j_end) {
+            render_samples_tile(camera, world, maximum_recursion_depth, i_begin, i_end, j_begin, j_end,
+                                first_sample, end_sample, accumulation);
+        };
+        std::vector<std::function<void()>> tasks = tiles(accumulation.width(), accumulation.height(), tile_function);
+        if (!by_samples) {
+            const long long tile_count = tasks.size();
+            tasks.erase(tasks.begin() + tile_count * (worker + 1) / worker_count, tasks.end());
+            tasks.erase(tasks.begin(), tasks.begin() + tile_count * worker / worker_count);
+        }
+        pool_.run(tasks);
+    }
+
+private:
+    // Divides a 'width' x 'height' image into tiles, and returns one task per tile calling 'tile_function',
+    // which must outlive the tasks.
+    std::vector<std::function<void()>> tiles(int width, int height, const TileFunction& tile_function) const {
+        const int tile_size = settings_.tile_size;
+        std::vector<std::function<void()>> tasks;
+        // Top to bottom, left to right, as the image is written out.
+        for (int j_end = height; j_end > 0; j_end -= tile_size) {
+            for (int i_begin = 0; i_begin < width; i_begin += tile_size) {
+                const int j_begin = std::max(0, j_end - tile_size);
+                const int i_end = std::min(width, i_begin + tile_size);
+                tasks.emplace_back([=, &tile_function]() { tile_function(i_begin, i_end, j_begin, j_end); });
+            }
+        }
+        return tasks;
+    }
+
+    // Renders pixels [i_begin, i_end) x [j_begin, j_end).
+    void render_tile(const Camera* camera, const Hittable* world, int maximum_recursion_depth,
+                     int i_begin, int i_end, int j_begin, int j_end, Framebuffer& framebuffer,
+                     std::vector<int>* sample_counts) const {
+        if (settings_.noise_threshold > 0.0) {
+            render_adaptive_tile(camera, world, maximum_recursion_depth, i_begin, i_end, j_begin, j_end, framebuffer,
+                                 sample_counts);
+            return;
+        }
+        for (int j = j_end - 1; j >= j_begin; --j) {
+            for (int i = i_begin; i < i_end; ++i) {
+                Color3 current_color;
+                Camera::antialiasing(current_color, camera, world, settings_.samples_per_pixel,
+                                     framebuffer.width(), framebuffer.height(), i, j,
+                                     maximum_recursion_depth, settings_.packet_size, settings_.seed,
+                                     settings_.russian_roulette_depth);
+                framebuffer.set_pixel(i, j, current_color);
+                if (sample_counts) (*sample_counts)[j * framebuffer.width() + i] = settings_.samples_per_pixel;
+            }
+        }
+    }
+
+    // Renders pixels [i_begin, i_end) x [j_begin, j_end) with adaptive sampling. In each round, every pixel
+    // that has not yet converged takes minimum_samples_per_pixel more samples, and keeps the running mean and
+    // variance of their luminance. A pixel has converged once it has samples_per_pixel samples, or once its
+    // noise is at most noise_threshold: the noise is the standard error of its mean luminance as it will be
+    // written out, i.e. after dampening, where 1.0 is full brightness. Dark and evenly lit pixels thus stop
+    // early, while edges and soft shadows take more samples.
+    // A pixel's first samples may all miss a small light and so seem to have no variance at all, so each
+    // pixel's variance is shrunk towards the mean variance of the tile, as if it had had a round of samples
+    // with that variance. A truly flat tile, such as empty background, still converges after one round.
+    void render_adaptive_tile(const Camera* camera, const Hittable* world, int maximum_recursion_depth,
+                              int i_begin, int i_end, int j_begin, int j_end, Framebuffer& framebuffer,
+                              std::vector<int>* sample_counts) const {
+        const int tile_width = i_end - i_begin;
+        const int pixel_count = tile_width * (j_end - j_begin);
+        const int maximum_samples = settings_.samples_per_pixel;
+        const int round_size = std::max(1, settings_.minimum_samples_per_pixel);
+        std::vector<RunningVariance> luminances(pixel_count);
+        std::vector<Color3> sums(pixel_count);
+        std::vector<bool> converged(pixel_count, maximum_samples <= 0);
+        for (bool has_active_pixels = maximum_samples > 0; has_active_pixels; ) {
+            for (int k = 0; k < pixel_count; ++k) {
+                if (converged[k]) continue;
+                const int i = i_begin + k % tile_width;
+                const int j = j_begin + k / tile_width;
+                const int samples = std::min(maximum_samples, luminances[k].count() + round_size);
+                while (luminances[k].count() < samples) {
+                    const Color3 sample = remove_NaN(Camera::sample_pixel(camera, world, framebuffer.width(),
+                                                                          framebuffer.height(), i, j,
+                                                                          luminances[k].count(),
+                                                                          maximum_recursion_depth, settings_.seed,
+                                                                          settings_.russian_roulette_depth));
+                    sums[k] += sample;
+                    luminances[k].add(0.2126 * sample.r() + 0.7152 * sample.g() + 0.0722 * sample.b());
+                }
+            }
+            value_type tile_variance = 0.0;
+            for (const RunningVariance& luminance : luminances) {
+                tile_variance += luminance.variance();
+            }
+            tile_variance /= value_type(pixel_count);
+            has_active_pixels = false;
+            for (int k = 0; k < pixel_count; ++k) {
+                if (converged[k]) continue;
+                converged[k] = luminances[k].count() >= maximum_samples
+                               || dampened_noise(luminances[k], tile_variance, round_size) <= settings_.noise_threshold;
+                has_active_pixels = has_active_pixels || !converged[k];
+            }
+        }
+        for (int k = 0; k < pixel_count; ++k) {
+            const int i = i_begin + k % tile_width;
+            const int j = j_begin + k / tile_width;
+            const int sample_count = luminances[k].count();
+            framebuffer.set_pixel(i, j, sample_count > 0 ? sums[k] / value_type(sample_count) : Color3());
+            if (sample_counts) (*sample_counts)[j * framebuffer.width() + i] = sample_count;
+        }
+    }
+
+    // The standard error of the mean of 'luminance' once dampened, i.e. how much its square root may be off,
+    // with its variance shrunk towards 'prior_variance' by 'prior_weight' values.
+    static value_type dampened_noise(const RunningVariance& luminance, value_type prior_variance,
+                                     value_type prior_weight) {
+        const value_type mean = std::max(value_type(0.0), luminance.mean());
+        const value_type standard_error = std::sqrt(luminance.variance(prior_variance, prior_weight)
+                                                    / value_type(luminance.count()));
+        return std::sqrt(mean + standard_error) - std::sqrt(mean);
+    }
+
+    // Adds one sample to each pixel of [i_begin, i_end) x [j_begin, j_end) with fewer than samples_per_pixel.
+    void render_pass_tile(const Camera* camera, const Hittable* world, int maximum_recursion_depth,
+                          int i_begin, int i_end, int j_begin, int j_end, AccumulationBuffer& accumulation) const {
+        for (int j = j_end - 1; j >= j_begin; --j) {
+            for (int i = i_begin; i < i_end; ++i) {
+                const uint32_t sample = accumulation.sample_count(i, j);
+                if (sample >= uint32_t(settings_.samples_per_pixel)) continue;
+                const Color3 color = Camera::sample_pixel(camera, world, accumulation.width(), accumulation.height(),
+                                                          i, j, sample, maximum_recursion_depth, settings_.seed,
+                                                          settings_.russian_roulette_depth);
+                accumulation.add_sample(i, j, remove_NaN(color));
+            }
+        }
+    }
+
+    // Adds up to 'samples' samples to each pixel of [i_begin, i_end) x [j_begin, j_end), without exceeding
+    // samples_per_pixel, and taking no more pixels once 'deadline' has passed.
+    void render_budgeted_tile(const Camera* camera, const Hittable* world, int maximum_recursion_depth,
+                              int i_begin, int i_end, int j_begin, int j_end, int samples,
+                              std::chrono::steady_clock::time_point deadline, AccumulationBuffer& accumulation) const {
+        for (int j = j_end - 1; j >= j_begin; --j) {
+            for (int i = i_begin; i < i_end; ++i) {
+                if (std::chrono::steady_clock::now() >= deadline) return;
+                const uint32_t first_sample = accumulation.sample_count(i, j);
+                const uint32_t end_sample = std::min(first_sample + uint32_t(samples),
+                                                     uint32_t(settings_.samples_per_pixel));
+                for (uint32_t sample = first_sample; sample < end_sample; ++sample) {
+                    const Color3 color = Camera::sample_pixel(camera, world, accumulation.width(),
+                                                              accumulation.height(), i, j, sample,
+                                                              maximum_recursion_depth, settings_.seed,
+                                                              settings_.russian_roulette_depth);
+                    accumulation.add_sample(i, j, remove_NaN(color));
+                }
+            }
+        }
+    }
+
+    // Adds samples [first_sample, end_sample) of each pixel of [i_begin, i_end) x [j_begin, j_end).
+    void render_samples_tile(const Camera* camera, const Hittable* world, int maximum_recursion_depth,
+                             int i_begin, int i_end, int j_begin, int j_end, int first_sample, int end_sample,
+                             AccumulationBuffer& accumulation) const {
+        for (int j = j_end - 1; j >= j_begin; --j) {
+            for (int i = i_begin; i < i_end; ++i) {
+                for (int sample = first_sample; sample < end_sample; ++sample) {
+                    const Color3 color = Camera::sample_pixel(camera, world, accumulation.width(),
+                                                              accumulation.height(), i, j, sample,
+                                                              maximum_recursion_depth, settings_.seed,
+                                                              settings_.russian_roulette_depth);
+                    accumulation.add_sample(i, j, remove_NaN(color));
+                }
+            }
+        }
+    }
+
+    RenderSettings settings_;
+    WorkStealingThreadPool pool_;
+};
+
+#endif //RAYTRACING_TILERENDERER_H
@@ -0,0 +1,268 @@
+#ifndef RAYTRACING_WAVEFRONTRENDERER_H
+#define RAYTRACING_WAVEFRONTRENDERER_H
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "Sampler.h"
+#include "ThreadPool.h"
+#include "TileRenderer.h"
+#include "../surfaces/Hittable.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+// Renders images as a wavefront. Rather than following one path at a time from the camera to its end,
+// which alternates between traversing the world, scattering off materials, and looking up textures,
+// it keeps a large batch of paths in flight and advances all of them one stage at a time:
+// 1. Generate: start paths from the camera in the free slots of the batch.
+// 2. Extend: find the closest hit of the ray of every path.
+// 3. Shade: add the light emitted at each hit, and scatter the path, with the paths grouped by material.
+// 4. Terminate: add the color of every finished path to its pixel, and move the others to the front.
+// Each stage is a tight loop doing the same kind of work over many paths, split between threads.
+// The paths are kept in structure-of-arrays form, so each stage only touches the fields it needs.
+// The paths take the same samples as with TileRenderer, so the two render the same image up to rounding.
+class WavefrontRenderer {
+public:
+    explicit WavefrontRenderer(const RenderSettings& settings) : settings_{settings}, pool_{settings.thread_count} {}
+
+    int thread_count() const { return pool_.thread_count(); }
+
+    // Renders the world as seen by 'camera' into every pixel of 'framebuffer', and returns once all are done.
+    void render(const Camera* camera, const Hittable* world, int maximum_recursion_depth, Framebuffer& framebuffer) {
+        const int samples_per_pixel = settings_.samples_per_pixel;
+        const long long pixel_count = (long long) framebuffer.width() * framebuffer.height();
+        const long long work = pixel_count * samples_per_pixel;
+        std::vector<Color3> sums(pixel_count);
+        PathStates paths(std::max(1, settings_.wavefront_size));
+        std::vector<int> shading_order;
+        long long next_work = 0;
+        int active = 0;
+        while (active > 0 || next_work < work) {
+            // Generate.
+            const int generated = int(std::min<long long>(paths.size() - active, work - next_work));
+            parallel_for(active, active + generated, [&](int k) {
+                const long long path_work = next_work + (k - active);
+                generate(camera, framebuffer, paths, k, path_work / samples_per_pixel, path_work % samples_per_pixel);
+            });
+            next_work += generated;
+            active += generated;
+
+            // Extend.
+            parallel_for(0, active, [&](int k) { extend(world, paths, k); });
+
+            // Shade, with the paths of each material together.
+            group_by_material(paths, active, shading_order);
+            parallel_for(0, int(shading_order.size()), [&](int position) {
+                shade(maximum_recursion_depth, paths, shading_order[position]);
+            });
+
+            // Terminate. Each pixel's paths are added in the order they finish, which is the same on every render.
+            int survivors = 0;
+            for (int k = 0; k < active; ++k) {
+                if (paths.alive[k]) {
+                    paths.move(k, survivors++);
+                } else {
+                    sums[paths.pixel[k]] += remove_NaN(paths.radiance(k));
+                }
+            }
+            active = survivors;
+        }
+        for (int j = 0; j < framebuffer.height(); ++j) {
+            for (int i = 0; i < framebuffer.width(); ++i) {
+                framebuffer.set_pixel(i, j, sums[j * framebuffer.width() + i] / value_type(samples_per_pixel));
+            }
+        }
+    }
+
+private:
+    // The state of a batch of paths, one element of each array per path.
+    struct PathStates {
+        explicit PathStates(int size) : origin_x(size), origin_y(size), origin_z(size), direction_x(size),
+                direction_y(size), direction_z(size), time(size), throughput_r(size), throughput_g(size),
+                throughput_b(size), radiance_r(size), radiance_g(size), radiance_b(size), depth(size),
+                pixel(size), alive(size), samplers(size), records(size) {}
+
+        int size() const { return int(alive.size()); }
+
+        Ray ray(int k) const {
+            return Ray(BoundVec3(origin_x[k], origin_y[k], origin_z[k]),
+                       UnitVec3(direction_x[k], direction_y[k], direction_z[k]), time[k]);
+        }
+
+        void set_ray(int k, const Ray& ray) {
+            const BoundVec3 origin = ray.origin();
+            const FreeVec3 direction = ray.direction().to_free();
+            origin_x[k] = origin.x();
+            origin_y[k] = origin.y();
+            origin_z[k] = origin.z();
+            direction_x[k] = direction.x();
+            direction_y[k] = direction.y();
+            direction_z[k] = direction.z();
+            time[k] = ray.time();
+        }
+
+        Color3 throughput(int k) const { return Color3(throughput_r[k], throughput_g[k], throughput_b[k]); }
+
+        void set_throughput(int k, const Color3& color) {
+            throughput_r[k] = color.r();
+            throughput_g[k] = color.g();
+            throughput_b[k] = color.b();
+        }
+
+        Color3 radiance(int k) const { return Color3(radiance_r[k], radiance_g[k], radiance_b[k]); }
+
+        void set_radiance(int k, const Color3& color) {
+            radiance_r[k] = color.r();
+            radiance_g[k] = color.g();
+            radiance_b[k] = color.b();
+        }
+
+        // Moves the path in slot 'from' to slot 'to'. Hit records are not moved, as they are only used
+        // between extending and shading.
+        void move(int from, int to) {
+            if (from == to) return;
+            origin_x[to] = origin_x[from];
+            origin_y[to] = origin_y[from];
+            origin_z[to] = origin_z[from];
+            direction_x[to] = direction_x[from];
+            direction_y[to] = direction_y[from];
+            direction_z[to] = direction_z[from];
+            time[to] = time[from];
+            throughput_r[to] = throughput_r[from];
+            throughput_g[to] = throughput_g[from];
+            throughput_b[to] = throughput_b[from];
+            radiance_r[to] = radiance_r[from];
+            radiance_g[to] = radiance_g[from];
+            radiance_b[to] = radiance_b[from];
+            depth[to] = depth[from];
+            pixel[to] = pixel[from];
+            alive[to] = alive[from];
+            samplers[to] = samplers[from];
+        }
+
+        // The ray the path follows next.
+        std::vector<value_type> origin_x, origin_y, origin_z;
+        std::vector<value_type> direction_x, direction_y, direction_z;
+        std::vector<value_type> time;
+        // The product of the attenuations along the path so far.
+        std::vector<value_type> throughput_r, throughput_g, throughput_b;
+        // The light gathered by the path so far.
+        std::vector<value_type> radiance_r, radiance_g, radiance_b;
+        // The number of bounces so far, and the pixel the path is a sample of.
+        std::vector<int> depth;
+        std::vector<long long> pixel;
+        // Whether the path goes on after the current stage.
+        std::vector<unsigned char> alive;
+        std::vector<Sampler> samplers;
+        // The closest hit of the path's ray, found by extend.
+        std::vector<HitRecord> records;
+    };
+
+    // Fills 'order' with the slots of the live paths among the first 'active', grouped by the material they hit.
+    // Within a group the slots are in increasing order, so that shading walks the arrays forwards.
+    static void group_by_material(const PathStates& paths, int active, std::vector<int>& order) {
+        std::unordered_map<const Material*, int> groups;
+        std::vector<int> group_sizes;
+        std::vector<int> path_groups(active, -1);
+        const Material* last_material = nullptr;
+        int last_group = -1;
+        for (int k = 0; k < active; ++k) {
+            if (!paths.alive[k]) continue;
+            const Material* material = paths.records[k].material.get();
+            if (material != last_material) {
+                const auto inserted = groups.emplace(material, int(group_sizes.size()));
+                if (inserted.second) group_sizes.push_back(0);
+                last_material = material;
+                last_group = inserted.first->second;
+            }
+            path_groups[k] = last_group;
+            ++group_sizes[last_group];
+        }
+        // Turn the sizes into the position of each group's first slot.
+        int live = 0;
+        for (int& group_size : group_sizes) {
+            const int size = group_size;
+            group_size = live;
+            live += size;
+        }
+        order.resize(live);
+        for (int k = 0; k < active; ++k) {
+            if (path_groups[k] >= 0) order[group_sizes[path_groups[k]]++] = k;
+        }
+    }
+
+    // Starts a path in slot 'k' for sample 'sample' of pixel 'pixel', as Camera::sample_pixel does.
+    void generate(const Camera* camera, const Framebuffer& framebuffer, PathStates& paths, int k,
+                  long long pixel, int sample) const {
+        const int x_pixels = framebuffer.width();
+        const int i = int(pixel % x_pixels);
+        const int j = int(pixel / x_pixels);
+        Sampler& sampler = paths.samplers[k];
+        sampler = Sampler(settings_.seed, pixel, sample);
+        const value_type u = value_type(i + sampler.next_value()) / value_type(x_pixels);
+        const value_type v = value_type(j + sampler.next_value()) / value_type(framebuffer.height());
+        paths.set_ray(k, camera->getRay(u, v, sampler));
+        paths.set_throughput(k, Color3(1.0, 1.0, 1.0));
+        paths.set_radiance(k, Color3());
+        paths.depth[k] = 0;
+        paths.pixel[k] = pixel;
+    }
+
+    // Finds the closest hit of the ray of the path in slot 'k'. A path whose ray escapes ends.
+    void extend(const Hittable* world, PathStates& paths, int k) const {
+        paths.alive[k] = world->hit(paths.ray(k), /*minimum=*/value_type(0.001),
+                                    /*maximum=*/std::numeric_limits<value_type>::max(), paths.records[k]);
+    }
+
+    // Adds the light emitted at the hit of the path in slot 'k', and scatters the path, as shade() does.
+    void shade(int maximum_recursion_depth, PathStates& paths, int k) const {
+        const HitRecord& record = paths.records[k];
+        const Material& material = *record.material;
+        Color3 throughput = paths.throughput(k);
+        paths.set_radiance(k, paths.radiance(k)
+                              + throughput * material.emitted(record.u, record.v, record.point_at_parameter));
+        Ray scattered;
+        Color3 attenuation;
+        Sampler& sampler = paths.samplers[k];
+        if (paths.depth[k] >= maximum_recursion_depth
+            || !material.scatter(paths.ray(k), record, attenuation, scattered, sampler)) {
+            paths.alive[k] = false;
+            return;
+        }
+        throughput = throughput * attenuation;
+        if (paths.depth[k] >= settings_.russian_roulette_depth) {
+            const value_type survival_probability = std::min(value_type(1.0),
+                    std::max({throughput.r(), throughput.g(), throughput.b()}));
+            if (sampler.next_value() >= survival_probability) {
+                paths.alive[k] = false;
+                return;
+            }
+            throughput /= survival_probability;
+        }
+        paths.set_throughput(k, throughput);
+        paths.set_ray(k, scattered);
+        ++paths.depth[k];
+    }
+
+    // Calls 'function' for each of [begin, end), split into chunks run by the pool.
+    template<typename Function>
+    void parallel_for(int begin, int end, const Function& function) {
+        const int chunk_size = 1024;
+        std::vector<std::function<void()>> chunks;
+        for (int chunk_begin = begin; chunk_begin < end; chunk_begin += chunk_size) {
+            const int chunk_end = std::min(end, chunk_begin + chunk_size);
+            chunks.emplace_back([=, &function]() {
+                for (int k = chunk_begin; k < chunk_end; ++k) {
+                    function(k);
+                }
+            });
+        }
+        pool_.run(chunks);
+    }
+
+    const RenderSettings settings_;
+    WorkStealingThreadPool pool_;
+};
+
+#endif //RAYTRACING_WAVEFRONTRENDERER_H
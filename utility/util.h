@@ -3,10 +3,12 @@
 #include "../surfaces/HittableWorld.h"
 #include "../surfaces/Sphere.h"
 #include "../surfaces/Hittable.h"
+#include <algorithm>
+#include <atomic>
 #include <limits>
-#include <functional>
 #include <random>
 #include "../material/Material.h"
+#include "Sampler.h"
 
 // A way to linearly interpolate between
 // a0 and a1. Weight should be in range [0.0, 1.0].
@@ -25,63 +27,105 @@ inline Color3 remove_NaN(const Color3& c) {
 
 // Generates a pseudorandom number between 0.0 and 1.0.
 // See: <random> for more information.
+// Each thread draws from its own generator, so that threads can build scenes at the same time. The first
+// thread to call this gets the default seed, and each later thread the next one.
+// Rendering draws from a Sampler instead, so that renders do not depend on how pixels are spread over threads.
 inline value_type random_value() {
-    static std::uniform_real_distribution<value_type> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    static std::function<value_type()> rand_generator =
-            std::bind(distribution, generator);
-    return rand_generator();
+    static std::atomic<unsigned> next_seed{std::mt19937::default_seed};
+    static thread_local std::uniform_real_distribution<value_type> distribution(0.0, 1.0);
+    static thread_local std::mt19937 generator(next_seed++);
+    return distribution(generator);
 }
 
 // Generates a random value in a unit disk, where
 // x, y, are bounded by [-1, 1] and z = 0.
-FreeVec3 random_value_in_unit_disk() {
+inline FreeVec3 random_value_in_unit_disk(Sampler& sampler) {
     FreeVec3 v;
     do {
-        v = FreeVec3(random_value(), random_value(), 0) * 2.0 - FreeVec3(1.0, 1.0, 0.0);
+        const value_type x = sampler.next_value();
+        const value_type y = sampler.next_value();
+        v = FreeVec3(x, y, 0) * 2.0 - FreeVec3(1.0, 1.0, 0.0);
     } while (v.dot(v) >= 1.0);
     return v;
 }
 
 // Generates a random value in a unit sphere, where
 // x, y, z are bounded by [-1, 1].
-FreeVec3 random_value_in_unit_sphere() {
+inline FreeVec3 random_value_in_unit_sphere(Sampler& sampler) {
     FreeVec3 v;
     do {
-        v = FreeVec3(random_value(), random_value(), random_value()) * 2.0 - FreeVec3(1.0, 1.0, 1.0);
+        const value_type x = sampler.next_value();
+        const value_type y = sampler.next_value();
+        const value_type z = sampler.next_value();
+        v = FreeVec3(x, y, z) * 2.0 - FreeVec3(1.0, 1.0, 1.0);
     } while (v.dot(v) >= 1.0);
     return v;
 }
 
 // Returns a unit vector with random cosine direction using spherical coordinates.
-inline UnitVec3 random_cosine_direction() {
-    const value_type r2 = random_value();
-    const value_type phi = 2.0 * M_PI * random_value();
+inline UnitVec3 random_cosine_direction(Sampler& sampler) {
+    const value_type r2 = sampler.next_value();
+    const value_type phi = 2.0 * M_PI * sampler.next_value();
     const value_type r2_sqrt = std::sqrt(r2);
     const value_type x = cos(phi) * r2_sqrt;
     const value_type y = sin(phi) * r2_sqrt;
     return UnitVec3(x, y, std::sqrt(1.0 - r2));
 }
 
+// The number of bounces a path makes before Russian roulette may end it, unless configured otherwise.
+constexpr int default_russian_roulette_depth = 3;
+
+// Colors a ray whose closest hit in the world, 'record', is already known. If it is within current
+// recursion boundaries, it proceeds to scatter or emit light. The random numbers of the path come from 'sampler'.
+// The path is followed in a loop rather than by recursion, carrying its throughput: the product of the
+// attenuations so far, which weighs the light emitted further along the path. Once the path has made
+// 'russian_roulette_depth' bounces, each further bounce only happens with a probability given by the
+// throughput, and the throughput of surviving paths is divided by that probability. Dim paths are thus
+// mostly cut short, while the expected color, and so the image, stays the same.
+[[nodiscard]] Color3 shade(const Ray& ray, const HitRecord& record, const Hittable *world,
+                           int maximum_recursion_depth, int current_recursion_depth, Sampler& sampler,
+                           int russian_roulette_depth = default_russian_roulette_depth) {
+    Color3 color;
+    Color3 throughput(1.0, 1.0, 1.0);
+    Ray current_ray = ray;
+    HitRecord current_record = record;
+    for (; ; ++current_recursion_depth) {
+        const Material& material = *current_record.material;
+        color += throughput * material.emitted(current_record.u, current_record.v, current_record.point_at_parameter);
+        Ray scattered;
+        Color3 attenuation;
+        if (current_recursion_depth >= maximum_recursion_depth
+            || !material.scatter(current_ray, current_record, attenuation, scattered, sampler)) {
+            break;
+        }
+        throughput = throughput * attenuation;
+        if (current_recursion_depth >= russian_roulette_depth) {
+            const value_type survival_probability = std::min(value_type(1.0),
+                    std::max({throughput.r(), throughput.g(), throughput.b()}));
+            if (sampler.next_value() >= survival_probability) break;
+            throughput /= survival_probability;
+        }
+        if (!world->hit(scattered, /*minimum=*/value_type(0.001),
+                        /*maximum=*/std::numeric_limits<value_type>::max(), current_record)) {
+            break;
+        }
+        current_ray = scattered;
+    }
+    return color;
+}
+
 // The currently ray coloring process during the anti-aliasing phase of raytracing.
 // It first determines if the ray has hit. Then, if it is within current recursion boundaries, it proceeds to
 // scatter or emit light. If it is not a hit, then the color Black (0, 0, 0) is returned.
 // The maximum recursion depth determines how many ray bounces are allowed.
-[[nodiscard]] Color3 ray_color(const Ray& ray, const Hittable *world, int maximum_recursion_depth, int current_recursion_depth) {
+[[nodiscard]] Color3 ray_color(const Ray& ray, const Hittable *world, int maximum_recursion_depth, int current_recursion_depth,
+                               Sampler& sampler, int russian_roulette_depth = default_russian_roulette_depth) {
     HitRecord record;
     const bool is_world_hit = world->hit(ray, /*minimum=*/value_type(0.001),
             /*maximum=*/std::numeric_limits<value_type>::max(), record);
     if (is_world_hit) {
-        Ray scattered;
-        Color3 attenuation;
-        const Color3 emitted_light = record.material->emitted(record.u, record.v, record.point_at_parameter);
-        const bool meets_recursion_depth_check = current_recursion_depth < maximum_recursion_depth;
-        if (meets_recursion_depth_check && record.material->scatter(ray, record, attenuation, scattered)) {
-            return emitted_light + (attenuation * ray_color(scattered, world,
-                                                  maximum_recursion_depth,
-                                                  ++current_recursion_depth));
-        }
-        return emitted_light;
+        return shade(ray, record, world, maximum_recursion_depth, current_recursion_depth, sampler,
+                     russian_roulette_depth);
     }
     return Color3(0.0, 0.0, 0.0);
 }